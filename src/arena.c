@@ -0,0 +1,144 @@
+#include "arena.h"
+#include "movie.h"
+#include "ppu.h"
+#include "state.h"
+#include "trace.h"
+#include "utils.h"
+#include <stdlib.h>
+
+#define PAGE_STRIDE ARENA_ALIGN(sizeof(MemoryPage))
+
+_Static_assert(ARENA_ALIGN(sizeof(Battery)) + ARENA_ALIGN(STATE_MAX_SIZE) +
+               MOVIE_INDEX_RESERVE * sizeof(MovieKeyframe) +
+               TRACE_BUFFER_SIZE + CACHE_LINE_SIZE <= ARENA_DEFAULT_OBJECT_BYTES,
+               "Default arena objects do not fit");
+
+Arena *createArena(const ArenaConfig *config) {
+    uint32_t forks = config && config->forks ? config->forks : ARENA_DEFAULT_FORKS;
+    uint32_t pages = config && config->pages ? config->pages : ARENA_PAGES(forks);
+    size_t objectBytes = ARENA_DEFAULT_OBJECT_BYTES + (1 + forks) * ARENA_ALIGN(sizeof(FrameBuffer)) +
+                         ARENA_ALIGN(config ? config->objectBytes : 0);
+    size_t header = ARENA_ALIGN(sizeof(Arena));
+
+    // Only the header is touched; the rest stays unbacked until first used
+    uint8_t *base = aligned_alloc(CACHE_LINE_SIZE, header + objectBytes + pages * PAGE_STRIDE);
+    if (!base) {
+        error("Failed to reserve arena of %u pages", pages);
+        return NULL;
+    }
+    Arena *arena = (Arena *)base;
+    atomic_init(&arena->refs, 1);
+    atomic_flag_clear(&arena->lock);
+    arena->freePages = NULL;
+    arena->freeObjects = NULL;
+    arena->nextObject = base + header;
+    arena->objectsEnd = arena->nextObject + objectBytes;
+    arena->nextPage = arena->objectsEnd;
+    arena->pagesEnd = arena->nextPage + pages * PAGE_STRIDE;
+    arena->heapPages = 0;
+    arena->heapObjects = 0;
+    return arena;
+}
+
+Arena *retainArena(Arena *arena) {
+    atomic_fetch_add(&arena->refs, 1);
+    return arena;
+}
+
+// Pages still held elsewhere must have been returned by now
+void releaseArena(Arena *arena) {
+    if (arena && atomic_fetch_sub(&arena->refs, 1) == 1) {
+        free(arena);
+    }
+}
+
+static void lockArena(Arena *arena) {
+    while (atomic_flag_test_and_set_explicit(&arena->lock, memory_order_acquire)) {
+    }
+}
+
+static void unlockArena(Arena *arena) {
+    atomic_flag_clear_explicit(&arena->lock, memory_order_release);
+}
+
+// Reuses a returned object of the same size before carving a new one, and
+// falls back to the heap once the reserved room runs out
+void *allocArenaObject(Arena *arena, size_t size) {
+    void *object = NULL;
+    size = ARENA_ALIGN(size);
+    lockArena(arena);
+    for (ArenaObject **entry = &arena->freeObjects; *entry; entry = &(*entry)->next) {
+        if ((*entry)->size == size) {
+            object = *entry;
+            *entry = (*entry)->next;
+            break;
+        }
+    }
+    if (!object && size <= (size_t)(arena->objectsEnd - arena->nextObject)) {
+        object = arena->nextObject;
+        arena->nextObject += size;
+    } else if (!object) {
+        arena->heapObjects++;
+    }
+    unlockArena(arena);
+    if (!object && !(object = aligned_alloc(CACHE_LINE_SIZE, size))) {
+        error("Failed to allocate a %zu byte object", size);
+    }
+    return object;
+}
+
+// `size` is the one the object was allocated with
+void freeArenaObject(Arena *arena, void *object, size_t size) {
+    uint8_t *address = object;
+    if (!object) {
+        return;
+    }
+    if (address < (uint8_t *)arena || address >= arena->objectsEnd) {
+        free(object);
+        return;
+    }
+    ArenaObject *entry = object;
+    entry->size = ARENA_ALIGN(size);
+    lockArena(arena);
+    entry->next = arena->freeObjects;
+    arena->freeObjects = entry;
+    unlockArena(arena);
+}
+
+// Falls back to the heap once the reserved pages run out
+MemoryPage *takeArenaPage(Arena *arena) {
+    MemoryPage *page = NULL;
+    if (arena) {
+        lockArena(arena);
+        if (arena->freePages) {
+            page = (MemoryPage *)arena->freePages;
+            arena->freePages = arena->freePages->next;
+        } else if (arena->nextPage < arena->pagesEnd) {
+            page = (MemoryPage *)arena->nextPage;
+            arena->nextPage += PAGE_STRIDE;
+        } else {
+            arena->heapPages++;
+        }
+        unlockArena(arena);
+    }
+    if (!page) {
+        page = aligned_alloc(CACHE_LINE_SIZE, PAGE_STRIDE);
+    }
+    if (page) {
+        atomic_init(&page->refs, 1);
+    }
+    return page;
+}
+
+void returnArenaPage(Arena *arena, MemoryPage *page) {
+    uint8_t *address = (uint8_t *)page;
+    if (!arena || address < arena->objectsEnd || address >= arena->pagesEnd) {
+        free(page);
+        return;
+    }
+    ArenaPage *entry = (ArenaPage *)page;
+    lockArena(arena);
+    entry->next = arena->freePages;
+    arena->freePages = entry;
+    unlockArena(arena);
+}
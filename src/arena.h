@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "memory.h"
+
+#define ARENA_DEFAULT_FORKS 1  // Such as a run-ahead snapshot
+#define ARENA_PAGES(forks) ((1 + (forks)) * RAM_PAGE_COUNT)  // Each may copy every page
+#define ARENA_DEFAULT_OBJECT_BYTES (160 * 1024)  // A save file, a movie and a trace reader
+#define ARENA_ALIGN(size) (((size) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1))
+
+// Zero fields take the defaults
+typedef struct {
+    uint32_t forks;       // Forks alive at once; pages and pictures are reserved
+                          // for each of them to copy all of its own
+    uint32_t pages;       // Memory pages, if not the ones `forks` asks for
+    size_t objectBytes;   // Room for objects on top of the default, such as the
+                          // instance itself or a heatmap
+} ArenaConfig;
+
+typedef struct ArenaPage {
+    struct ArenaPage *next;
+} ArenaPage;
+
+typedef struct ArenaObject {
+    struct ArenaObject *next;
+    size_t size;
+} ArenaObject;
+
+// Everything an instance allocates, reserved in one block up front. Objects
+// are carved off the front and recycled by size; memory pages are recycled
+// through a free list. Forks share their parent's arena,
+// which goes back to the heap in one piece once its last user is freed.
+typedef struct Arena {
+    atomic_uint refs;        // Instances using the arena
+    atomic_flag lock;        // Guards the page lists against forks on other threads
+    ArenaPage *freePages;    // Returned pages, reused before fresh ones
+    ArenaObject *freeObjects;  // Returned objects, reused for the same size
+    uint8_t *nextPage;       // Pages never handed out start here
+    uint8_t *pagesEnd;
+    uint8_t *nextObject;
+    uint8_t *objectsEnd;
+    uint32_t heapPages;      // Pages that did not fit and came from the heap
+    uint32_t heapObjects;    // Likewise for objects
+} Arena;
+
+Arena *createArena(const ArenaConfig *config);
+Arena *retainArena(Arena *arena);
+void releaseArena(Arena *arena);
+void *allocArenaObject(Arena *arena, size_t size);
+void freeArenaObject(Arena *arena, void *object, size_t size);
+MemoryPage *takeArenaPage(Arena *arena);
+void returnArenaPage(Arena *arena, MemoryPage *page);
+
+#endif
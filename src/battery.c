@@ -0,0 +1,100 @@
+#include "battery.h"
+#include "arena.h"
+#include "hosttime.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Maps the first `size` bytes of the save file, growing a short or missing
+// file with zeroes. Longer files (e.g. with RTC data appended) keep their tail.
+Battery *openBattery(struct Arena *arena, const char *savePath, uint32_t size) {
+    Battery *battery = allocArenaObject(arena, sizeof(Battery));
+    if (!battery) {
+        return NULL;
+    }
+    battery->fd = open(savePath, O_RDWR | O_CREAT, 0644);
+    if (battery->fd < 0) {
+        error("Failed to open save file: %s", savePath);
+        freeArenaObject(arena, battery, sizeof(Battery));
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(battery->fd, &info) != 0 ||
+        (info.st_size < size && ftruncate(battery->fd, size) != 0)) {
+        error("Failed to size save file: %s", savePath);
+        close(battery->fd);
+        freeArenaObject(arena, battery, sizeof(Battery));
+        return NULL;
+    }
+    battery->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, battery->fd, 0);
+    if (battery->data == MAP_FAILED) {
+        error("Failed to map save file: %s", savePath);
+        close(battery->fd);
+        freeArenaObject(arena, battery, sizeof(Battery));
+        return NULL;
+    }
+    battery->size = size;
+    battery->dirty = 0;
+    battery->lastFlush = hostTimeNanos();
+    battery->flushes = 0;
+    info("Cartridge RAM backed by %s", savePath);
+    return battery;
+}
+
+static int syncRange(Battery *battery, uintptr_t start, uintptr_t end) {
+    if (msync((void *)start, end - start, MS_SYNC) != 0) {
+        uintptr_t base = (uintptr_t)battery->data;
+        error("Failed to flush cartridge RAM bytes 0x%lx-0x%lx",
+              (unsigned long)(start - base), (unsigned long)(end - base - 1));
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the dirty pages back to the file, one msync per contiguous run.
+// msync works on host pages, which may be larger than the 4KB pages
+// tracked, so each run is widened to host page boundaries and runs that
+// then meet are merged.
+int syncBattery(Battery *battery) {
+    uintptr_t hostPage = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t base = (uintptr_t)battery->data;
+    uintptr_t start = 0, end = 0;  // Run not synced yet, empty if end is 0
+    uint32_t pages = battery->size / MEMORY_PAGE_SIZE;
+    int status = 0;
+    for (uint32_t page = 0; page < pages; page++) {
+        if (!(battery->dirty & (1u << page))) {
+            continue;
+        }
+        uintptr_t from = (base + page * MEMORY_PAGE_SIZE) & ~(hostPage - 1);
+        uintptr_t to = (base + (page + 1) * MEMORY_PAGE_SIZE + hostPage - 1) & ~(hostPage - 1);
+        if (end && from > end) {
+            status |= syncRange(battery, start, end);
+            end = 0;
+        }
+        if (!end) {
+            start = from;
+        }
+        end = to;
+    }
+    if (end) {
+        status |= syncRange(battery, start, end);
+    }
+    battery->dirty = 0;
+    battery->lastFlush = hostTimeNanos();
+    battery->flushes++;
+    return status;
+}
+
+void closeBattery(struct Arena *arena, Battery *battery) {
+    if (!battery) {
+        return;
+    }
+    syncBattery(battery);
+    munmap(battery->data, battery->size);
+    close(battery->fd);
+    freeArenaObject(arena, battery, sizeof(Battery));
+}
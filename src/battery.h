@@ -0,0 +1,30 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define BATTERY_FLUSH_NANOS 1000000000ull  // At most this much is lost on a crash
+
+// Save file mapped for an instance's cartridge RAM. The instance keeps the
+// RAM in ordinary pages rather than in the mapping, so forks can share them
+// and run-ahead frames that get thrown away never reach the file; the 4KB
+// pages written since the last flush are tracked in `dirty`, copied into
+// the mapping and synced to disk in contiguous ranges.
+typedef struct Battery {
+    int fd;
+    uint8_t *data;
+    uint32_t size;
+    uint32_t dirty;       // One bit per 4KB page
+    uint64_t lastFlush;   // Host time of the last flush
+    uint32_t flushes;
+} Battery;
+
+struct Arena;
+
+// Allocated from the instance's arena
+Battery *openBattery(struct Arena *arena, const char *savePath, uint32_t size);
+int syncBattery(Battery *battery);
+void closeBattery(struct Arena *arena, Battery *battery);
+
+#endif
@@ -0,0 +1,140 @@
+#include "cartridge.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_TITLE 0x0134
+#define HEADER_TYPE 0x0147
+#define HEADER_RAM_SIZE 0x0149
+
+static MBCType mbcForType(uint8_t type) {
+    switch (type) {
+        case 0x00: case 0x08: case 0x09: return MBC_NONE;
+        case 0x01: case 0x02: case 0x03: return MBC_1;
+        case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13: return MBC_3;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E: return MBC_5;
+        default:
+            error("Unsupported cartridge type 0x%02X, treating as ROM only", type);
+            return MBC_NONE;
+    }
+}
+
+static int batteryForType(uint8_t type) {
+    switch (type) {
+        case 0x03: case 0x09: case 0x0F: case 0x10: case 0x13: case 0x1B: case 0x1E:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static uint32_t ramBanksForSize(uint8_t code) {
+    switch (code) {
+        case 0x02: return 1;
+        case 0x03: return 4;
+        case 0x04: return 16;
+        case 0x05: return 8;
+        default: return code == 0x01 ? 1 : 0;  // 2KB carts still use one bank
+    }
+}
+
+// Takes ownership of `rom`, already padded to `romBanks` whole banks
+static Cartridge *createCartridge(uint8_t *rom, uint32_t romBanks) {
+    Cartridge *cartridge = malloc(sizeof(Cartridge));
+    if (!cartridge) {
+        error("Failed to allocate cartridge");
+        free(rom);
+        return NULL;
+    }
+
+    atomic_init(&cartridge->refs, 1);
+    cartridge->rom = rom;
+    cartridge->romBanks = romBanks;
+    cartridge->type = rom[HEADER_TYPE];
+    cartridge->mbc = mbcForType(cartridge->type);
+    cartridge->ramBanks = ramBanksForSize(rom[HEADER_RAM_SIZE]);
+    if (cartridge->ramBanks > MAX_RAM_BANKS) {
+        error("Cartridge RAM limited to %d banks", MAX_RAM_BANKS);
+        cartridge->ramBanks = MAX_RAM_BANKS;
+    }
+    cartridge->hasBattery = batteryForType(cartridge->type) && cartridge->ramBanks;
+    memcpy(cartridge->title, &rom[HEADER_TITLE], 16);
+    cartridge->title[16] = '\0';
+    return cartridge;
+}
+
+// Allocates the padded ROM image; missing bytes read as open bus
+static uint8_t *allocROM(size_t size, uint32_t *romBanks) {
+    if (size <= HEADER_RAM_SIZE || size > 512 * ROM_BANK_SIZE) {
+        error("Invalid ROM size: %zu bytes", size);
+        return NULL;
+    }
+
+    // Always map at least banks 0 and 1
+    *romBanks = (size + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE;
+    if (*romBanks < 2) *romBanks = 2;
+
+    uint8_t *rom = malloc((size_t)*romBanks * ROM_BANK_SIZE);
+    if (!rom) {
+        error("Failed to allocate ROM");
+        return NULL;
+    }
+    memset(rom, 0xFF, (size_t)*romBanks * ROM_BANK_SIZE);
+    return rom;
+}
+
+Cartridge *loadCartridge(const char *filePath) {
+    FILE *file = fopen(filePath, "rb");
+    if (!file) {
+        error("Failed to open ROM: %s", filePath);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+
+    uint32_t romBanks;
+    uint8_t *rom = allocROM(fileSize > 0 ? fileSize : 0, &romBanks);
+    if (!rom) {
+        fclose(file);
+        return NULL;
+    }
+    if (fread(rom, 1, fileSize, file) != (size_t)fileSize) {
+        error("Failed to read ROM: %s", filePath);
+        free(rom);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    Cartridge *cartridge = createCartridge(rom, romBanks);
+    if (cartridge) {
+        success("ROM loaded: %s (%ld bytes)", filePath, fileSize);
+    }
+    return cartridge;
+}
+
+// Copies an image the caller already has in memory
+Cartridge *loadCartridgeFromMemory(const uint8_t *data, size_t size) {
+    uint32_t romBanks;
+    uint8_t *rom = allocROM(size, &romBanks);
+    if (!rom) {
+        return NULL;
+    }
+    memcpy(rom, data, size);
+    return createCartridge(rom, romBanks);
+}
+
+Cartridge *retainCartridge(Cartridge *cartridge) {
+    atomic_fetch_add(&cartridge->refs, 1);
+    return cartridge;
+}
+
+void releaseCartridge(Cartridge *cartridge) {
+    if (cartridge && atomic_fetch_sub(&cartridge->refs, 1) == 1) {
+        free(cartridge->rom);
+        free(cartridge);
+    }
+}
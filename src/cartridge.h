@@ -0,0 +1,33 @@
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "config.h"
+
+typedef enum {
+    MBC_NONE,
+    MBC_1,
+    MBC_3,
+    MBC_5
+} MBCType;
+
+// Immutable once loaded and shared by every instance running the same ROM
+typedef struct {
+    atomic_uint refs;     // Instances holding this cartridge
+    uint8_t *rom;         // ROM image padded to whole banks
+    uint32_t romBanks;    // Number of 16KB ROM banks
+    uint32_t ramBanks;    // Number of 8KB RAM banks
+    uint8_t type;         // Cartridge type byte from the header
+    MBCType mbc;
+    uint8_t hasBattery;   // Cartridge RAM is meant to persist
+    char title[17];
+} Cartridge;
+
+Cartridge *loadCartridge(const char *filePath);
+Cartridge *loadCartridgeFromMemory(const uint8_t *data, size_t size);
+Cartridge *retainCartridge(Cartridge *cartridge);
+void releaseCartridge(Cartridge *cartridge);
+
+#endif
@@ -3,6 +3,14 @@
 
 #define GAMEBOY_CLOCK_SPEED 4194304  // 4.19 MHz CPU
 #define MEMORY_SIZE 0x10000  // 64KB addressable space
+#define MEMORY_PAGE_SHIFT 12  // 4KB pages
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_COUNT (MEMORY_SIZE >> MEMORY_PAGE_SHIFT)
 #define ROM_BANK_SIZE 0x4000  // 16KB per ROM bank
+#define RAM_BANK_SIZE 0x2000  // 8KB per cartridge RAM bank
+#define MAX_RAM_BANKS 4  // 32KB of cartridge RAM
+#define CACHE_LINE_SIZE 64
+#define CYCLES_PER_FRAME 70224  // 154 scanlines of 456 cycles
+#define FRAME_NANOS (CYCLES_PER_FRAME * 1000000000ull / GAMEBOY_CLOCK_SPEED)
 
 #endif 
@@ -1,5 +1,7 @@
 #include "cpu.h"
+#include "idiom.h"
 #include "utils.h"
+#include <string.h>
 
 
 static uint8_t* getRegister(CPU *cpu, Register reg) {
@@ -16,6 +18,7 @@ static uint8_t* getRegister(CPU *cpu, Register reg) {
     }
 }
 
+#ifdef DEBUG
 static const char* getRegisterName(Register reg) {
     switch (reg) {
         case REG_B: return "B";
@@ -30,6 +33,7 @@ static const char* getRegisterName(Register reg) {
         default: return "UNKNOWN";
     }
 }
+#endif
 
 static void NOP(CPU *cpu, Memory *memory, Register reg1, Register reg2) {
     (void)cpu; (void)memory; (void)reg1; (void)reg2;
@@ -68,6 +72,46 @@ static void LD_m_A(CPU *cpu, Memory *memory, Register highReg, Register lowReg)
     p_instr("LD (0x%04X) <- A: 0x%02X", address, cpu->a);
 }
 
+static void LD_mHLI_A(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    uint16_t address = (cpu->h << 8) | cpu->l;
+    writeByte(memory, address, cpu->a);
+    address++;
+    cpu->h = address >> 8;
+    cpu->l = address & 0xFF;
+    p_instr("LD (HL+) <- A: 0x%02X", cpu->a);
+}
+
+static void LD_mHLD_A(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    uint16_t address = (cpu->h << 8) | cpu->l;
+    writeByte(memory, address, cpu->a);
+    address--;
+    cpu->h = address >> 8;
+    cpu->l = address & 0xFF;
+    p_instr("LD (HL-) <- A: 0x%02X", cpu->a);
+}
+
+static void LD_A_mHLI(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    uint16_t address = (cpu->h << 8) | cpu->l;
+    cpu->a = readByte(memory, address);
+    address++;
+    cpu->h = address >> 8;
+    cpu->l = address & 0xFF;
+    p_instr("LD A <- (HL+): 0x%02X", cpu->a);
+}
+
+static void LD_A_mHLD(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    uint16_t address = (cpu->h << 8) | cpu->l;
+    cpu->a = readByte(memory, address);
+    address--;
+    cpu->h = address >> 8;
+    cpu->l = address & 0xFF;
+    p_instr("LD A <- (HL-): 0x%02X", cpu->a);
+}
+
 static void LD_m_d8(CPU *cpu, Memory *memory, Register highReg, Register lowReg) {
     uint16_t address = (*getRegister(cpu, highReg) << 8) | *getRegister(cpu, lowReg);
     uint8_t value = readByte(memory, cpu->pc++);
@@ -169,6 +213,37 @@ static void LD_HL_SP_plus_s8(CPU *cpu, Memory *memory, Register unused1, Registe
     p_instr("LD HL <- SP + s8: SP=0x%04X, s8=%d, Result=0x%04X", cpu->sp, offset, result);
 }
 
+// 16bit arithmetic instructions
+static void INC_rr(CPU *cpu, Memory *memory, Register highReg, Register lowReg) {
+    (void)memory;
+    uint8_t *high = getRegister(cpu, highReg);
+    uint8_t *low = getRegister(cpu, lowReg);
+    if (high && low) {
+        uint16_t value = ((*high << 8) | *low) + 1;
+        *high = value >> 8;
+        *low = value & 0xFF;
+        p_instr("INC %s%s -> 0x%04X", getRegisterName(highReg), getRegisterName(lowReg), value);
+    } else {
+        cpu->sp++;
+        p_instr("INC SP -> 0x%04X", cpu->sp);
+    }
+}
+
+static void DEC_rr(CPU *cpu, Memory *memory, Register highReg, Register lowReg) {
+    (void)memory;
+    uint8_t *high = getRegister(cpu, highReg);
+    uint8_t *low = getRegister(cpu, lowReg);
+    if (high && low) {
+        uint16_t value = ((*high << 8) | *low) - 1;
+        *high = value >> 8;
+        *low = value & 0xFF;
+        p_instr("DEC %s%s -> 0x%04X", getRegisterName(highReg), getRegisterName(lowReg), value);
+    } else {
+        cpu->sp--;
+        p_instr("DEC SP -> 0x%04X", cpu->sp);
+    }
+}
+
 // 8bit arithmetic/logical instructions
 static void setFlagsInc(CPU *cpu, uint8_t result) {
     // Z flag
@@ -538,10 +613,53 @@ static void CP_A_d8(CPU *cpu, Memory *memory, Register unused1, Register unused2
     p_instr("CP A, d8: A=0x%02X, operand=0x%02X", cpu->a, value);
 }
 
+// Jump instructions
+// Taken relative jumps cost 4 more cycles than the table entry
+static void jumpRelative(CPU *cpu, Memory *memory, int condition) {
+    int8_t offset = (int8_t)readByte(memory, cpu->pc++);
+    if (!condition) {
+        p_instr("JR not taken");
+        return;
+    }
+    uint16_t branch = cpu->pc - 2;
+    cpu->pc += offset;
+    addCycles(&cpu->timer, 4);
+    p_instr("JR s8: s8=%d, PC=0x%04X", offset, cpu->pc);
+    if (offset < 0) {
+        accelerateLoop(cpu, memory, branch);
+    }
+}
+
+static void JR_s8(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    jumpRelative(cpu, memory, 1);
+}
+
+static void JR_NZ_s8(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    jumpRelative(cpu, memory, !(cpu->f & 0x80));
+}
+
+static void JR_Z_s8(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    jumpRelative(cpu, memory, cpu->f & 0x80);
+}
+
+static void JR_NC_s8(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    jumpRelative(cpu, memory, !(cpu->f & 0x10));
+}
+
+static void JR_C_s8(CPU *cpu, Memory *memory, Register unused1, Register unused2) {
+    (void)unused1; (void)unused2;
+    jumpRelative(cpu, memory, cpu->f & 0x10);
+}
+
 
 // Opcode table with metadata
 // format: instr | REG_1 | REG2 | cycles 
-Instruction opcodeTable[256] = {
+// Shared by every instance, so never written after compilation
+static const Instruction opcodeTable[256] = {
     [0x00] = { NOP, REG_NONE, REG_NONE, 4},                 // NOP
 
     // 8bit load/store/move instructions
@@ -553,13 +671,13 @@ Instruction opcodeTable[256] = {
     [0x16] = { LD_r_d8, REG_D, REG_NONE, 8 },               // LD D, d8
     [0x1A] = { LD_A_m, REG_D, REG_E, 8 },                   // LD A, (DE)
     [0x1E] = { LD_r_d8, REG_E, REG_NONE, 8 },               // LD E, d8
-    [0x22] = { LD_m_A, REG_H, REG_L, 8 },                   // LD (HL+), A
+    [0x22] = { LD_mHLI_A, REG_NONE, REG_NONE, 8 },          // LD (HL+), A
     [0x26] = { LD_r_d8, REG_H, REG_NONE, 8 },               // LD H, d8
-    [0x2A] = { LD_A_m, REG_H, REG_L, 8 },                   // LD A, (HL+)
+    [0x2A] = { LD_A_mHLI, REG_NONE, REG_NONE, 8 },          // LD A, (HL+)
     [0x2E] = { LD_r_d8, REG_L, REG_NONE, 8 },               // LD L, d8
-    [0x32] = { LD_m_A, REG_H, REG_L, 8 },                   // LD (HL-), A
+    [0x32] = { LD_mHLD_A, REG_NONE, REG_NONE, 8 },          // LD (HL-), A
     [0x36] = { LD_m_d8, REG_H, REG_L, 12 },                 // LD (HL), d8
-    [0x3A] = { LD_A_m, REG_H, REG_L, 8 },                   // LD A, (HL-)
+    [0x3A] = { LD_A_mHLD, REG_NONE, REG_NONE, 8 },          // LD A, (HL-)
     [0x3E] = { LD_r_d8, REG_A, REG_NONE, 8 },               // LD A, d8
     [0x40] = { LD_r_r, REG_B, REG_B, 4 },                   // LD B, B
     [0x41] = { LD_r_r, REG_B, REG_C, 4 },                   // LD B, C
@@ -648,6 +766,23 @@ Instruction opcodeTable[256] = {
     [0xF8] = { LD_HL_SP_plus_s8, REG_NONE, REG_NONE, 12 },  // LD HL, SP+s8
     [0xF9] = { LD_SP_HL, REG_NONE, REG_NONE, 8 },           // LD SP, HL
 
+    // 16bit arithmetic instructions
+    [0x03] = { INC_rr, REG_B, REG_C, 8 },                   // INC BC
+    [0x0B] = { DEC_rr, REG_B, REG_C, 8 },                   // DEC BC
+    [0x13] = { INC_rr, REG_D, REG_E, 8 },                   // INC DE
+    [0x1B] = { DEC_rr, REG_D, REG_E, 8 },                   // DEC DE
+    [0x23] = { INC_rr, REG_H, REG_L, 8 },                   // INC HL
+    [0x2B] = { DEC_rr, REG_H, REG_L, 8 },                   // DEC HL
+    [0x33] = { INC_rr, REG_NONE, REG_NONE, 8 },             // INC SP
+    [0x3B] = { DEC_rr, REG_NONE, REG_NONE, 8 },             // DEC SP
+
+    // Jump instructions (cycles when not taken)
+    [0x18] = { JR_s8, REG_NONE, REG_NONE, 8 },              // JR s8
+    [0x20] = { JR_NZ_s8, REG_NONE, REG_NONE, 8 },           // JR NZ, s8
+    [0x28] = { JR_Z_s8, REG_NONE, REG_NONE, 8 },            // JR Z, s8
+    [0x30] = { JR_NC_s8, REG_NONE, REG_NONE, 8 },           // JR NC, s8
+    [0x38] = { JR_C_s8, REG_NONE, REG_NONE, 8 },            // JR C, s8
+
     // 8bit arithmetic/logical instructions
     [0x04] = { INC_r, REG_B, REG_NONE, 4 },                 // INC B
     [0x05] = { DEC_r, REG_B, REG_NONE, 4 },                 // DEC B
@@ -752,18 +887,37 @@ void initCPU(CPU *cpu) {
     cpu->ime = 1;      // Enable interrupts by default
     cpu->halted = 0;
     initTimer(&cpu->timer);
+    cpu->instructions = 0;
+    initLoopCache(cpu);
+    memset(cpu->unknownOpcodes, 0, sizeof(cpu->unknownOpcodes));
 
     debug("CPU Initialized");
 }
 
 void executeNextInstruction(CPU *cpu, Memory *memory) {
-    uint8_t opcode = readByte(memory, cpu->pc++);
+    uint8_t opcode = fetchByte(memory, cpu->pc++);
     Instruction instr = opcodeTable[opcode];
 
     if (instr.execute) {
         instr.execute(cpu, memory, instr.reg1, instr.reg2);
         addCycles(&cpu->timer, instr.cycles);
     } else {
-        error("Unknown opcode: 0x%02X", opcode);
+        // Reported once per instance; runs on as a NOP so time keeps moving
+        if (!(cpu->unknownOpcodes[opcode >> 5] & (1u << (opcode & 31)))) {
+            cpu->unknownOpcodes[opcode >> 5] |= 1u << (opcode & 31);
+            error("Unknown opcode: 0x%02X at 0x%04X", opcode, (uint16_t)(cpu->pc - 1));
+        }
+        addCycles(&cpu->timer, 4);
+    }
+}
+
+// Opcodes with an entry in opcodeTable
+int implementedOpcodes(void) {
+    int count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (opcodeTable[i].execute) {
+            count++;
+        }
     }
+    return count;
 }
@@ -18,6 +18,17 @@ typedef struct Instruction {
     uint8_t cycles;
 } Instruction;
 
+#define LOOP_CACHE_SIZE 64  // Power of two
+
+// Decoded backward-branch targets, see idiom.c
+typedef struct {
+    uint16_t pc;       // Loop start
+    uint16_t branch;   // JR NZ closing the loop
+    uint16_t bank;     // ROM bank mapped when the loop was decoded
+    uint8_t kind;      // LoopKind
+    uint8_t counter;   // Register counting iterations down
+} LoopCacheEntry;
+
 typedef struct CPU {
     uint8_t a, f;              // Accumulator & Flags
     uint8_t b, c, d, e, h, l;  // General-purpose registers
@@ -25,9 +36,17 @@ typedef struct CPU {
     uint8_t ime;               // Interrupt Master Enable flag
     uint8_t halted;            // Halt state
     Timer timer;               // Timer for tracking cycles
+    uint64_t instructions;     // Instructions interpreted, added up per frame slice
+    uint64_t acceleratedCycles;  // Cycles covered by native bulk loops
+    uint32_t acceleratedLoops;
+    uint32_t loopCacheHits;
+    uint32_t loopCacheMisses;
+    LoopCacheEntry loopCache[LOOP_CACHE_SIZE];
+    uint32_t unknownOpcodes[8];  // Bitmap of unimplemented opcodes executed
 } CPU;
 
 void initCPU(CPU *cpu);
 void executeNextInstruction(CPU *cpu, Memory *memory);
+int implementedOpcodes(void);
 
 #endif
@@ -0,0 +1,205 @@
+#include "framestream.h"
+#include "utils.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Delta payload tokens, applied left to right over the previous frame:
+//   0x00-0x7F  keep the next (token + 1) pixels
+//   0x80-0xFF  replace the next (token - 0x7F) pixels with the bytes that follow
+// Each frame is preceded by its frame number and payload size (u32 LE each);
+// an unchanged frame has an empty payload.
+
+static int writeAll(int fd, const uint8_t *data, size_t size) {
+    while (size) {
+        ssize_t count = write(fd, data, size);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += count;
+        size -= count;
+    }
+    return 0;
+}
+
+static void putU32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint32_t encodeDelta(const uint8_t *frame, const uint8_t *previous, uint8_t *out) {
+    uint32_t size = 0;
+    int i = 0;
+    while (i < FRAME_PIXELS) {
+        int run = 0;
+        if (frame[i] == previous[i]) {
+            while (i + run < FRAME_PIXELS && run < 128 && frame[i + run] == previous[i + run]) {
+                run++;
+            }
+            // A trailing unchanged stretch needs no token at all
+            if (i + run < FRAME_PIXELS) {
+                out[size++] = run - 1;
+            }
+        } else {
+            while (i + run < FRAME_PIXELS && run < 128 && frame[i + run] != previous[i + run]) {
+                run++;
+            }
+            out[size++] = 0x7F + run;
+            memcpy(&out[size], &frame[i], run);
+            size += run;
+        }
+        i += run;
+    }
+    return size;
+}
+
+static int writeFrame(FrameWriter *writer, uint32_t number) {
+    if (writer->format == FRAMES_RAW) {
+        writer->bytes += FRAME_PIXELS;
+        return writeAll(writer->fd, writer->current, FRAME_PIXELS);
+    }
+    uint32_t size = encodeDelta(writer->current, writer->previous, writer->encoded + 8);
+    putU32(writer->encoded, number);
+    putU32(writer->encoded + 4, size);
+    memcpy(writer->previous, writer->current, FRAME_PIXELS);
+    writer->bytes += size + 8;
+    return writeAll(writer->fd, writer->encoded, size + 8);
+}
+
+static void *frameWriterThread(void *arg) {
+    FrameWriter *writer = arg;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->pending && !writer->stopping) {
+            pthread_cond_wait(&writer->ready, &writer->lock);
+        }
+        if (!writer->pending) {
+            break;
+        }
+        int front = 1 - writer->back;
+        uint32_t number = writer->numbers[front];
+        memcpy(writer->current, writer->frames[front], FRAME_PIXELS);
+        writer->pending = 0;
+        writer->writing = 1;
+        pthread_mutex_unlock(&writer->lock);
+
+        int status = writeFrame(writer, number);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->writing = 0;
+        if (status != 0) {
+            writer->failed = 1;
+            break;
+        }
+        writer->written++;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// `target` is a file descriptor number or a file path
+int startFrameWriter(FrameWriter *writer, const char *target, FrameFormat format) {
+    int isNumber = *target != '\0';
+    for (const char *c = target; *c; c++) {
+        isNumber &= isdigit((unsigned char)*c) != 0;
+    }
+    writer->ownsFd = !isNumber;
+    writer->fd = isNumber ? atoi(target) : open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0 || (isNumber && fcntl(writer->fd, F_GETFD) < 0)) {
+        error("Failed to open frame output: %s", target);
+        return -1;
+    }
+    // A reader going away shows up as a write error instead of a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    writer->format = format;
+    writer->back = 0;
+    writer->pending = 0;
+    writer->writing = 0;
+    writer->stopping = 0;
+    writer->failed = 0;
+    writer->written = 0;
+    writer->dropped = 0;
+    writer->bytes = 0;
+    memset(writer->frames, 0, sizeof(writer->frames));
+    memset(writer->previous, 0, sizeof(writer->previous));
+
+    if (format == FRAMES_DELTA) {
+        uint8_t header[16] = { 0 };
+        memcpy(header, FRAME_STREAM_MAGIC, 4);
+        header[4] = FRAME_STREAM_VERSION;
+        header[6] = FRAME_WIDTH;
+        header[8] = FRAME_HEIGHT;
+        header[10] = format;
+        if (writeAll(writer->fd, header, sizeof(header)) != 0) {
+            error("Failed to write frame stream header");
+            if (writer->ownsFd) close(writer->fd);
+            return -1;
+        }
+        writer->bytes = sizeof(header);
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->ready, NULL);
+    if (pthread_create(&writer->thread, NULL, frameWriterThread, writer) != 0) {
+        error("Failed to start frame writer thread");
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->ready);
+        if (writer->ownsFd) close(writer->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Buffer to render the next frame into; only valid until submitFrame
+uint8_t *frameWriterBuffer(FrameWriter *writer) {
+    return writer->frames[writer->back];
+}
+
+// Publishes the rendered buffer and swaps. Never waits for the output: the
+// lock is only ever held for a buffer copy.
+void submitFrame(FrameWriter *writer, uint32_t number) {
+    pthread_mutex_lock(&writer->lock);
+    if (!writer->failed) {
+        if (writer->pending) {
+            writer->dropped++;
+        }
+        writer->numbers[writer->back] = number;
+        writer->back = 1 - writer->back;
+        writer->pending = 1;
+        pthread_cond_signal(&writer->ready);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+// Frames submitted that the output has not taken in yet, 0 to 2
+int frameWriterBacklog(FrameWriter *writer) {
+    pthread_mutex_lock(&writer->lock);
+    int backlog = writer->failed ? 0 : writer->pending + writer->writing;
+    pthread_mutex_unlock(&writer->lock);
+    return backlog;
+}
+
+// Writes out the last pending frame and closes the output
+void stopFrameWriter(FrameWriter *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = 1;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->ready);
+
+    if (writer->failed) {
+        error("Frame output failed after %llu frames", (unsigned long long)writer->written);
+    }
+    if (writer->ownsFd) {
+        close(writer->fd);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "video.h"
+
+#define FRAME_STREAM_MAGIC "NBFS"
+#define FRAME_STREAM_VERSION 1
+#define FRAME_DELTA_MAX (FRAME_PIXELS / 2 * 3)  // Single changed pixels between single kept ones
+
+typedef enum {
+    FRAMES_RAW,    // Bare 160x144 shade bytes per frame, no headers
+    FRAMES_DELTA   // Stream header, then RLE of the changes to the previous frame
+} FrameFormat;
+
+// Double-buffered: the emulator renders into `frames[back]` and hands it over
+// without waiting; the writer thread copies the other buffer out, encodes and
+// writes it. A frame not yet taken when the next one arrives is replaced.
+typedef struct {
+    int fd;
+    int ownsFd;
+    FrameFormat format;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    uint8_t frames[2][FRAME_PIXELS];
+    uint32_t numbers[2];         // Emulated frame number of each buffer
+    int back;                    // Buffer owned by the emulator
+    int pending;                 // The other buffer holds an untaken frame
+    int writing;                 // The writer thread is still writing a frame out
+    int stopping;
+    int failed;                  // Output closed or errored, stop encoding
+    uint8_t current[FRAME_PIXELS];   // Writer thread only from here on
+    uint8_t previous[FRAME_PIXELS];
+    uint8_t encoded[FRAME_DELTA_MAX + 8];
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t bytes;
+} FrameWriter;
+
+int startFrameWriter(FrameWriter *writer, const char *target, FrameFormat format);
+uint8_t *frameWriterBuffer(FrameWriter *writer);
+void submitFrame(FrameWriter *writer, uint32_t number);
+int frameWriterBacklog(FrameWriter *writer);
+void stopFrameWriter(FrameWriter *writer);
+
+#endif
@@ -1,17 +1,95 @@
 #include "gameboy.h"
+#include "link.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdbool.h>
 
-void initGameBoy(GameBoy *gameBoy) {
+_Static_assert(sizeof(GameBoy) <= GAMEBOY_FIXED_BUDGET,
+               "Instance outgrew its budget; keep large buffers in the arena");
+
+// Instances in the same arena draw their memory pages from one reservation;
+// NULL reserves a default-sized arena for this instance alone
+int initGameBoy(GameBoy *gameBoy, struct Arena *arena) {
     initCPU(&gameBoy->cpu);
-    initMemory(&gameBoy->memory);
+    if (initMemory(&gameBoy->memory, arena) != 0) {
+        return -1;
+    }
+    if (initPPU(&gameBoy->ppu, &gameBoy->memory, &gameBoy->cpu.timer.cycleCount) != 0) {
+        freeMemory(&gameBoy->memory);
+        return -1;
+    }
+    gameBoy->memory.timer = &gameBoy->cpu.timer;
+    mirrorTimerRegisters(&gameBoy->memory);
     gameBoy->running = true;
+    gameBoy->frameStart = 0;
+    gameBoy->frames = 0;
+    gameBoy->link = NULL;
     debug("Game Boy Initialized");
+    return 0;
+}
+
+void freeGameBoy(GameBoy *gameBoy) {
+    freePPU(&gameBoy->ppu, &gameBoy->memory);
+    freeMemory(&gameBoy->memory);
+}
+
+// The child starts as an exact copy that shares all memory pages with the
+// parent; a page is only duplicated once either side writes to it
+void forkGameBoy(GameBoy *child, GameBoy *parent) {
+    child->cpu = parent->cpu;
+    forkMemory(&child->memory, &parent->memory);
+    forkPPU(&child->ppu, &parent->ppu, &child->memory, &child->cpu.timer.cycleCount);
+    child->memory.timer = &child->cpu.timer;
+    child->running = parent->running;
+    child->frameStart = parent->frameStart;
+    child->frames = parent->frames;
+    child->link = NULL;
+}
+
+// Replaces the instance with a fork taken from it earlier, consuming the
+// fork. The link cable stays plugged into the instance.
+void restoreGameBoy(GameBoy *gameBoy, GameBoy *snapshot) {
+    restorePPU(&gameBoy->ppu, &snapshot->ppu, &gameBoy->memory, &gameBoy->cpu.timer.cycleCount);
+    restoreMemory(&gameBoy->memory, &snapshot->memory);
+    gameBoy->cpu = snapshot->cpu;
+    gameBoy->memory.timer = &gameBoy->cpu.timer;
+    gameBoy->running = snapshot->running;
+    gameBoy->frameStart = snapshot->frameStart;
+    gameBoy->frames = snapshot->frames;
+}
+
+// Lets a snapshot hold the save file while the instance runs frames that
+// will be thrown away
+void moveGameBoyBattery(GameBoy *to, GameBoy *from) {
+    moveBattery(&to->memory, &from->memory);
+}
+
+// Instance footprint, counting shared pages and pictures proportionally
+uint32_t gameBoyResidentBytes(const GameBoy *gameBoy) {
+    const FrameBuffer *frame = gameBoy->ppu.frame;
+    return sizeof(GameBoy) - sizeof(Memory) + memoryResidentBytes(&gameBoy->memory) +
+           (frame ? sizeof(FrameBuffer) / atomic_load(&frame->refs) : 0);
+}
+
+// For instances whose picture nobody looks at, such as search forks: they
+// keep full timing but stop drawing, and hold no framebuffer
+void setGameBoyHeadless(GameBoy *gameBoy) {
+    detachPPUFrame(&gameBoy->ppu, &gameBoy->memory);
 }
 
 int loadGameBoyROM(GameBoy *gameBoy, const char *filePath) {
-    return loadROM(&gameBoy->memory, filePath);
+    Cartridge *cartridge = loadCartridge(filePath);
+    if (!cartridge) {
+        return -1;
+    }
+    insertGameBoyCartridge(gameBoy, cartridge);
+    releaseCartridge(cartridge);
+    return 0;
+}
+
+// Instances running the same game can share one loaded cartridge
+void insertGameBoyCartridge(GameBoy *gameBoy, Cartridge *cartridge) {
+    insertCartridge(&gameBoy->memory, cartridge);
 }
 
 void runGameBoy(GameBoy *gameBoy) {
@@ -35,3 +113,72 @@ void stepGameBoy(GameBoy *gameBoy, int cycles) {
         }
     }
 }
+
+// Runs until the cycle count reaches `end`, counting every frame boundary
+// passed on the way; overshoot carries into the next frame. A linked
+// instance expects its peer to be run on another thread meanwhile (use
+// runLinkedFrame to drive both from one). Returns -1 if the peer stalled
+// past the link's stall timeout, with the slice unfinished; see
+// waitLinkedUntil.
+int runGameBoyUntil(GameBoy *gameBoy, uint64_t end) {
+    Timer *timer = &gameBoy->cpu.timer;
+    if (gameBoy->link) {
+        if (waitLinkedUntil(gameBoy, end) != 0) {
+            return -1;
+        }
+    } else {
+        uint64_t executed = 0;  // Kept in a register, stored once per slice
+        while (timer->cycleCount < end) {
+            if (!gameBoy->cpu.halted) {
+                executeNextInstruction(&gameBoy->cpu, &gameBoy->memory);
+                executed++;
+            } else {
+                // Nothing can wake the CPU yet, so idle out the rest of the frame
+                timer->cycleCount = end;
+            }
+        }
+        gameBoy->cpu.instructions += executed;
+    }
+    // Bring the picture, IF and the timer registers up to date even if
+    // nothing touched them
+    runPPU(&gameBoy->ppu, &gameBoy->memory);
+    updateTimerInterrupt(&gameBoy->memory);
+    mirrorTimerRegisters(&gameBoy->memory);
+    uint32_t frames = gameBoy->frames;
+    if (realignGameBoyFrame(gameBoy)) {
+        gameBoy->frames++;
+    }
+    while (timer->cycleCount >= gameBoy->frameStart + CYCLES_PER_FRAME) {
+        gameBoy->frameStart += CYCLES_PER_FRAME;
+        gameBoy->frames++;
+    }
+    if (gameBoy->frames != frames) {
+        flushBattery(&gameBoy->memory, 0);
+    }
+    return 0;
+}
+
+// Frames follow the display: once the LCD is switched back on, the frame
+// in progress ends and the next one starts with line 0, so the buffer at
+// every later frame boundary holds a whole picture. Returns 1 if the frame
+// start moved.
+int realignGameBoyFrame(GameBoy *gameBoy) {
+    PPU *ppu = &gameBoy->ppu;
+    if (!ppu->restarted) {
+        return 0;
+    }
+    ppu->restarted = 0;
+    if (ppu->restartCycle == gameBoy->frameStart) {
+        return 0;
+    }
+    gameBoy->frameStart = ppu->restartCycle;
+    return 1;
+}
+
+int runGameBoyFrame(GameBoy *gameBoy) {
+    return runGameBoyUntil(gameBoy, gameBoy->frameStart + CYCLES_PER_FRAME);
+}
+
+void setGameBoyInput(GameBoy *gameBoy, uint8_t buttons) {
+    gameBoy->memory.joypad = buttons;
+}
@@ -3,16 +3,44 @@
 
 #include "cpu.h"
 #include "memory.h"
+#include "ppu.h"
 
+struct LinkPort;
+
+// A quarter of the flat 64KB instance this layout replaced, so at least 4x
+// as many instances fit per GB; nanobench --check-resident holds forks to it
+#define GAMEBOY_RESIDENT_BUDGET (MEMORY_SIZE / 4)
+#define GAMEBOY_FIXED_BUDGET 2048  // The struct itself, before any RAM page is written
+
+// Only per-instance mutable state lives here; the ROM is shared through the
+// cartridge. Frame scheduling and the CPU registers share the first cache
+// line, the memory slot tables used on every access start on their own.
+// The PPU comes last, as it is touched least often; its framebuffer lives
+// in the arena and is shared with forks until either side draws.
 typedef struct {
-    CPU cpu;
-    Memory memory;
+    _Alignas(CACHE_LINE_SIZE) uint64_t frameStart;  // Cycle count at which the current frame began
+    uint32_t frames;      // Frames emulated since power-on
     int running;
+    struct LinkPort *link;  // Serial link to another instance, NULL if unplugged
+    CPU cpu;
+    _Alignas(CACHE_LINE_SIZE) Memory memory;
+    _Alignas(CACHE_LINE_SIZE) PPU ppu;
 } GameBoy;
 
-void initGameBoy(GameBoy *gameBoy);
+int initGameBoy(GameBoy *gameBoy, struct Arena *arena);
+void freeGameBoy(GameBoy *gameBoy);
+void forkGameBoy(GameBoy *child, GameBoy *parent);
+void restoreGameBoy(GameBoy *gameBoy, GameBoy *snapshot);
+void moveGameBoyBattery(GameBoy *to, GameBoy *from);
+uint32_t gameBoyResidentBytes(const GameBoy *gameBoy);
+void setGameBoyHeadless(GameBoy *gameBoy);
 int loadGameBoyROM(GameBoy *gameBoy, const char *filePath);
+void insertGameBoyCartridge(GameBoy *gameBoy, Cartridge *cartridge);
 void runGameBoy(GameBoy *gameBoy);
 void stepGameBoy(GameBoy *gameBoy, int cycles);
+int runGameBoyUntil(GameBoy *gameBoy, uint64_t end);
+int runGameBoyFrame(GameBoy *gameBoy);
+int realignGameBoyFrame(GameBoy *gameBoy);
+void setGameBoyInput(GameBoy *gameBoy, uint8_t buttons);
 
 #endif 
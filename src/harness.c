@@ -0,0 +1,364 @@
+#include "harness.h"
+#include "gameboy.h"
+#include "hosttime.h"
+#include "state.h"
+#include "utils.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Test ROMs report their verdict in one of three common ways:
+//  - text containing "Passed" or "Failed" sent over the serial port
+//  - a status byte at 0xA000 behind the signature DE B0 61 at 0xA001
+//  - B, C, D, E, H, L set to 3, 5, 8, 13, 21, 34 (pass) or all to 0x42 (fail)
+//    before a LD B,B breakpoint or a jump to itself
+
+typedef struct {
+    TestRun *runs;
+    int count;
+    uint64_t budget;
+    PPUEngine ppuEngine;
+    int comparePPU;
+    atomic_int next;  // Next ROM to hand to a worker
+} TestQueue;
+
+static int hasROMExtension(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (strcmp(dot, ".gb") == 0 || strcmp(dot, ".gbc") == 0);
+}
+
+static int compareRuns(const void *a, const void *b) {
+    return strcmp(((const TestRun *)a)->path, ((const TestRun *)b)->path);
+}
+
+// Collects the ROMs of a directory in name order
+static TestRun *listTestROMs(const char *directory, int *count) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        error("Failed to open test ROM directory: %s", directory);
+        return NULL;
+    }
+
+    TestRun *runs = NULL;
+    int capacity = 0;
+    struct dirent *entry;
+    *count = 0;
+    while ((entry = readdir(dir))) {
+        if (!hasROMExtension(entry->d_name)) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            TestRun *grown = realloc(runs, capacity * sizeof(TestRun));
+            if (!grown) {
+                error("Failed to allocate test list");
+                free(runs);
+                closedir(dir);
+                return NULL;
+            }
+            runs = grown;
+        }
+        TestRun *run = &runs[(*count)++];
+        memset(run, 0, sizeof(TestRun));
+        snprintf(run->path, sizeof(run->path), "%s/%s", directory, entry->d_name);
+    }
+    closedir(dir);
+
+    if (*count == 0) {
+        error("No .gb or .gbc files in %s", directory);
+        free(runs);
+        return NULL;
+    }
+    qsort(runs, *count, sizeof(TestRun), compareRuns);
+    return runs;
+}
+
+// Keeps the byte and completes the transfer as if no cable were attached
+static void captureSerial(TestRun *run, Memory *memory) {
+    uint8_t data = memory->high[SERIAL_DATA - HIGH_MEMORY_START];
+    if (run->serialLength < TEST_SERIAL_SIZE - 1) {
+        run->serial[run->serialLength++] = data;
+        run->serial[run->serialLength] = '\0';
+    }
+    memory->high[SERIAL_DATA - HIGH_MEMORY_START] = 0xFF;
+    memory->high[SERIAL_CONTROL - HIGH_MEMORY_START] &= 0x7F;
+    memory->high[INTERRUPT_FLAG - HIGH_MEMORY_START] |= INTERRUPT_SERIAL;
+    memory->serialRequest = 0;
+}
+
+static int setVerdict(TestRun *run, TestResult result, const char *detail) {
+    run->result = result;
+    snprintf(run->detail, sizeof(run->detail), "%s", detail);
+    return 1;
+}
+
+// Returns 1 once the ROM has reported a result
+static int checkVerdict(TestRun *run, GameBoy *gameBoy) {
+    CPU *cpu = &gameBoy->cpu;
+    Memory *memory = &gameBoy->memory;
+
+    if (strstr(run->serial, "Passed")) return setVerdict(run, TEST_PASS, "serial");
+    if (strstr(run->serial, "Failed")) return setVerdict(run, TEST_FAIL, "serial");
+
+    if (readByte(memory, 0xA001) == 0xDE && readByte(memory, 0xA002) == 0xB0 &&
+        readByte(memory, 0xA003) == 0x61) {
+        uint8_t status = readByte(memory, 0xA000);
+        if (status != 0x80) {
+            char detail[32];
+            snprintf(detail, sizeof(detail), "status byte 0x%02X", status);
+            return setVerdict(run, status == 0 ? TEST_PASS : TEST_FAIL, detail);
+        }
+    }
+
+    uint8_t opcode = readByte(memory, cpu->pc);
+    int selfLoop = opcode == 0x18 && readByte(memory, cpu->pc + 1) == 0xFE;
+    if (opcode == 0x40 || selfLoop) {
+        if (cpu->b == 3 && cpu->c == 5 && cpu->d == 8 && cpu->e == 13 &&
+            cpu->h == 21 && cpu->l == 34) {
+            return setVerdict(run, TEST_PASS, "registers");
+        }
+        if (cpu->b == 0x42 && cpu->c == 0x42 && cpu->d == 0x42 && cpu->e == 0x42 &&
+            cpu->h == 0x42 && cpu->l == 0x42) {
+            return setVerdict(run, TEST_FAIL, "registers");
+        }
+        // Without interrupts enabled nothing can ever leave the loop
+        if (selfLoop && !cpu->ime) {
+            char detail[32];
+            snprintf(detail, sizeof(detail), "stuck at 0x%04X", cpu->pc);
+            return setVerdict(run, TEST_FAIL, detail);
+        }
+    }
+    return 0;
+}
+
+// LD B,B or JR -2 at `pc`, where the register convention reports. Code in
+// high memory is left to the check between slices.
+static int atBreakpoint(const Memory *memory, uint16_t pc) {
+    const uint8_t *code = readableMemory(memory, pc);
+    if (!code) {
+        return 0;
+    }
+    const uint8_t *next = readableMemory(memory, pc + 1);
+    return *code == 0x40 || (*code == 0x18 && next && *next == 0xFE);
+}
+
+static void runTestROM(TestRun *run, uint64_t budget, PPUEngine ppuEngine) {
+    GameBoy gameBoy;
+    CPU *cpu = &gameBoy.cpu;
+    Memory *memory = &gameBoy.memory;
+    uint64_t start = hostTimeNanos();
+
+    if (initGameBoy(&gameBoy, NULL) != 0) {
+        setVerdict(run, TEST_ERROR, "init failed");
+        return;
+    }
+    selectPPUEngine(&gameBoy.ppu, ppuEngine);
+    if (loadGameBoyROM(&gameBoy, run->path) != 0) {
+        setVerdict(run, TEST_ERROR, "load failed");
+        freeGameBoy(&gameBoy);
+        return;
+    }
+
+    setVerdict(run, TEST_TIMEOUT, "cycle budget exhausted");
+    while (cpu->timer.cycleCount < budget) {
+        uint64_t slice = cpu->timer.cycleCount + TEST_CHECK_CYCLES;
+        if (slice > budget) {
+            slice = budget;
+        }
+        while (cpu->timer.cycleCount < slice && !cpu->halted) {
+            uint16_t pc = cpu->pc;
+            executeNextInstruction(cpu, memory);
+            if (memory->serialRequest) {
+                captureSerial(run, memory);
+            }
+            // Check on arrival only, so a loop waiting for an interrupt
+            // does not stop every instruction
+            if (cpu->pc != pc && atBreakpoint(memory, cpu->pc)) {
+                break;
+            }
+        }
+        if (checkVerdict(run, &gameBoy)) {
+            break;
+        }
+        if (cpu->halted) {
+            char detail[32];
+            snprintf(detail, sizeof(detail), "halted at 0x%04X", cpu->pc);
+            setVerdict(run, TEST_FAIL, detail);
+            break;
+        }
+    }
+
+    runPPU(&gameBoy.ppu, memory);
+    run->frameHash = hashState(gameBoy.ppu.frame->pixels, FRAME_PIXELS);
+    run->cycles = cpu->timer.cycleCount;
+    run->hostNanos = hostTimeNanos() - start;
+    memcpy(run->unknownOpcodes, cpu->unknownOpcodes, sizeof(run->unknownOpcodes));
+    freeGameBoy(&gameBoy);
+}
+
+// Both engines share their timing, so a ROM without mid-line register
+// writes has to end on the same picture with either
+static void comparePPUEngines(TestRun *run, PPUEngine engine, uint64_t budget) {
+    TestRun other;
+    memset(&other, 0, sizeof(other));
+    memcpy(other.path, run->path, sizeof(other.path));
+    runTestROM(&other, budget, engine == PPU_SCANLINE ? PPU_FIFO : PPU_SCANLINE);
+    run->hostNanos += other.hostNanos;
+    if (other.result != TEST_PASS) {
+        setVerdict(run, other.result, "failed on the other PPU engine");
+    } else if (other.frameHash != run->frameHash) {
+        setVerdict(run, TEST_FAIL, "PPU engines drew different frames");
+    }
+}
+
+static void *testWorker(void *arg) {
+    TestQueue *queue = arg;
+    int index;
+    while ((index = atomic_fetch_add(&queue->next, 1)) < queue->count) {
+        TestRun *run = &queue->runs[index];
+        runTestROM(run, queue->budget, queue->ppuEngine);
+        if (queue->comparePPU && run->result == TEST_PASS) {
+            comparePPUEngines(run, queue->ppuEngine, queue->budget);
+        }
+    }
+    return NULL;
+}
+
+static const char *resultName(TestResult result) {
+    switch (result) {
+        case TEST_PASS: return "PASS";
+        case TEST_FAIL: return "FAIL";
+        case TEST_TIMEOUT: return "TIMEOUT";
+        default: return "ERROR";
+    }
+}
+
+static int hitOpcode(const uint32_t *bitmap, int opcode) {
+    return (bitmap[opcode >> 5] >> (opcode & 31)) & 1;
+}
+
+static int writeReport(const TestRun *runs, int count, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        error("Failed to open report file: %s", path);
+        return -1;
+    }
+    fprintf(file, "rom,result,detail,cycles,host_ms,emulated_mhz,frame_hash,unknown_opcodes\n");
+    for (int i = 0; i < count; i++) {
+        const TestRun *run = &runs[i];
+        fprintf(file, "%s,%s,%s,%llu,%.3f,%.2f,%016llx,", run->path, resultName(run->result),
+                run->detail, (unsigned long long)run->cycles, run->hostNanos / 1e6,
+                run->hostNanos ? run->cycles * 1e3 / run->hostNanos : 0.0,
+                (unsigned long long)run->frameHash);
+        const char *separator = "";
+        for (int opcode = 0; opcode < 256; opcode++) {
+            if (hitOpcode(run->unknownOpcodes, opcode)) {
+                fprintf(file, "%s%02X", separator, opcode);
+                separator = " ";
+            }
+        }
+        fputc('\n', file);
+    }
+    if (ferror(file) | fclose(file)) {
+        error("Failed to write report file: %s", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Prints the unimplemented opcodes hit by any ROM, most widespread first
+static void printMissingOpcodes(const TestRun *runs, int count) {
+    int hits[256] = { 0 };
+    for (int i = 0; i < count; i++) {
+        for (int opcode = 0; opcode < 256; opcode++) {
+            hits[opcode] += hitOpcode(runs[i].unknownOpcodes, opcode);
+        }
+    }
+
+    char line[1024];
+    int length = 0;
+    for (int shown = 0; shown < 256 && length < (int)sizeof(line) - 16; shown++) {
+        int best = -1;
+        for (int opcode = 0; opcode < 256; opcode++) {
+            if (hits[opcode] && (best < 0 || hits[opcode] > hits[best])) {
+                best = opcode;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        length += snprintf(line + length, sizeof(line) - length, " %02X(%d)", best, hits[best]);
+        hits[best] = 0;
+    }
+    info("Opcode table: %d/256 implemented; missing opcodes hit (ROMs):%s",
+         implementedOpcodes(), length ? line : " none");
+}
+
+// Runs every .gb/.gbc file of `directory` on a pool of worker threads.
+// Returns 0 only if every ROM passed.
+int runTestROMs(const char *directory, const HarnessOptions *options) {
+    TestQueue queue;
+    queue.runs = listTestROMs(directory, &queue.count);
+    if (!queue.runs) {
+        return -1;
+    }
+    queue.budget = options->budget;
+    queue.ppuEngine = options->ppuEngine;
+    queue.comparePPU = options->comparePPU;
+    atomic_init(&queue.next, 0);
+
+    int jobs = options->jobs > 0 ? options->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > queue.count) jobs = queue.count;
+    pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+    if (!threads) {
+        error("Failed to allocate %d workers", jobs);
+        free(queue.runs);
+        return -1;
+    }
+
+    uint64_t start = hostTimeNanos();
+    int started = 0;
+    for (; started < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, testWorker, &queue) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        testWorker(&queue);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t wallNanos = hostTimeNanos() - start;
+    free(threads);
+
+    int passed = 0;
+    uint64_t totalCycles = 0;
+    for (int i = 0; i < queue.count; i++) {
+        TestRun *run = &queue.runs[i];
+        totalCycles += run->cycles;
+        if (run->result == TEST_PASS) {
+            passed++;
+            success("PASS    %s (%s) %llu cycles in %.1f ms", run->path, run->detail,
+                    (unsigned long long)run->cycles, run->hostNanos / 1e6);
+        } else {
+            error("%-7s %s (%s) %llu cycles in %.1f ms", resultName(run->result), run->path,
+                  run->detail, (unsigned long long)run->cycles, run->hostNanos / 1e6);
+        }
+    }
+    info("Passed %d/%d ROMs with %d workers in %.1f ms, %.1f emulated MHz overall",
+         passed, queue.count, started ? started : 1, wallNanos / 1e6,
+         wallNanos ? totalCycles * 1e3 / wallNanos : 0.0);
+    printMissingOpcodes(queue.runs, queue.count);
+
+    int status = passed == queue.count ? 0 : -1;
+    if (options->reportPath && writeReport(queue.runs, queue.count, options->reportPath) != 0) {
+        status = -1;
+    }
+    free(queue.runs);
+    return status;
+}
@@ -0,0 +1,41 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdint.h>
+#include <limits.h>
+#include "ppu.h"
+
+#define TEST_DEFAULT_BUDGET 250000000ULL  // About a minute of emulated time
+#define TEST_SERIAL_SIZE 1024
+#define TEST_CHECK_CYCLES 4096            // Serial and status byte checks between slices
+
+typedef enum {
+    TEST_PASS,
+    TEST_FAIL,
+    TEST_TIMEOUT,  // Budget ran out without a verdict
+    TEST_ERROR     // ROM could not be loaded
+} TestResult;
+
+typedef struct {
+    char path[PATH_MAX];
+    TestResult result;
+    char detail[64];                   // How the verdict was reached
+    uint64_t cycles;                   // Emulated cycles
+    uint64_t hostNanos;
+    char serial[TEST_SERIAL_SIZE];     // Serial output, NUL-terminated
+    uint32_t serialLength;
+    uint32_t unknownOpcodes[8];        // Unimplemented opcodes the ROM hit
+    uint64_t frameHash;                // Framebuffer when the run ended
+} TestRun;
+
+typedef struct {
+    uint64_t budget;        // Cycle budget per ROM
+    int jobs;               // Worker threads, 0 for one per core
+    const char *reportPath; // CSV report, NULL for none
+    PPUEngine ppuEngine;
+    int comparePPU;         // Rerun passes on the other engine, fail if the frame differs
+} HarnessOptions;
+
+int runTestROMs(const char *directory, const HarnessOptions *options);
+
+#endif
@@ -0,0 +1,174 @@
+#include "heatmap.h"
+#include "arena.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEATMAP_MAGIC "NBHM"
+#define HEATMAP_VERSION 1
+
+static uint32_t heatmapLines(const Cartridge *cartridge) {
+    return cartridge->romBanks * HEAT_BANK_LINES + HEAT_RAM_LINES + HEAT_HIGH_LINES;
+}
+
+// Room to reserve in an arena for the cartridge's heatmap
+size_t heatmapBytes(const Cartridge *cartridge) {
+    return ARENA_ALIGN(sizeof(Heatmap)) + heatmapLines(cartridge) * sizeof(uint64_t[HEAT_KINDS]);
+}
+
+// The counts follow the header in one arena object
+Heatmap *createHeatmap(struct Arena *arena, const Cartridge *cartridge) {
+    Heatmap *heatmap = allocArenaObject(arena, heatmapBytes(cartridge));
+    if (!heatmap) {
+        error("Failed to allocate heatmap");
+        return NULL;
+    }
+    heatmap->romBanks = cartridge->romBanks;
+    heatmap->ramBase = cartridge->romBanks * HEAT_BANK_LINES;
+    heatmap->highBase = heatmap->ramBase + HEAT_RAM_LINES;
+    heatmap->lineCount = heatmapLines(cartridge);
+    heatmap->counts = (void *)((uint8_t *)heatmap + ARENA_ALIGN(sizeof(Heatmap)));
+    memset(heatmap->counts, 0, heatmap->lineCount * sizeof(*heatmap->counts));
+    return heatmap;
+}
+
+void freeHeatmap(struct Arena *arena, Heatmap *heatmap) {
+    if (heatmap) {
+        freeArenaObject(arena, heatmap, ARENA_ALIGN(sizeof(Heatmap)) +
+                        heatmap->lineCount * sizeof(*heatmap->counts));
+    }
+}
+
+// Names the region a line belongs to, with its bank and CPU address
+static const char *lineRegion(const Heatmap *heatmap, uint32_t line,
+                              uint32_t *bank, uint16_t *address) {
+    if (line < heatmap->ramBase) {
+        *bank = line / HEAT_BANK_LINES;
+        *address = ((line % HEAT_BANK_LINES) << HEAT_LINE_SHIFT) + (*bank ? 0x4000 : 0);
+        return "ROM";
+    }
+    if (line < heatmap->highBase) {
+        uint32_t offset = (line - heatmap->ramBase) << HEAT_LINE_SHIFT;
+        *bank = offset / RAM_BANK_SIZE;
+        *address = 0xA000 + offset % RAM_BANK_SIZE;
+        return "Cart RAM";
+    }
+    *bank = 0;
+    *address = 0x8000 + ((line - heatmap->highBase) << HEAT_LINE_SHIFT);
+    if (*address < 0xA000) return "VRAM";
+    if (*address < 0xC000) return "Unused";
+    if (*address < 0xE000) return "WRAM";
+    if (*address < 0xFE00) return "Echo RAM";
+    if (*address < 0xFEA0) return "OAM";
+    if (*address < 0xFF00) return "Unused";
+    if (*address < 0xFF80) return "I/O";
+    return "HRAM";
+}
+
+static int exportCSV(const Heatmap *heatmap, FILE *file) {
+    fprintf(file, "region,bank,address,reads,writes,executes\n");
+    for (uint32_t line = 0; line < heatmap->lineCount; line++) {
+        const uint64_t *counts = heatmap->counts[line];
+        if (!counts[HEAT_READ] && !counts[HEAT_WRITE] && !counts[HEAT_EXECUTE]) {
+            continue;
+        }
+        uint32_t bank;
+        uint16_t address;
+        const char *region = lineRegion(heatmap, line, &bank, &address);
+        fprintf(file, "%s,%u,0x%04X,%llu,%llu,%llu\n", region, bank, address,
+                (unsigned long long)counts[HEAT_READ], (unsigned long long)counts[HEAT_WRITE],
+                (unsigned long long)counts[HEAT_EXECUTE]);
+    }
+    return 0;
+}
+
+// "NBHM", version u32, line shift u32, ROM banks u32, RAM banks u32, line
+// count u32, then reads, writes and executes as u64 for every line, all
+// little-endian
+static int exportBinary(const Heatmap *heatmap, FILE *file) {
+    uint32_t header[5] = { HEATMAP_VERSION, HEAT_LINE_SHIFT, heatmap->romBanks,
+                           MAX_RAM_BANKS, heatmap->lineCount };
+    fwrite(HEATMAP_MAGIC, 1, 4, file);
+    for (int i = 0; i < 5; i++) {
+        for (int b = 0; b < 4; b++) {
+            fputc((uint8_t)(header[i] >> (b * 8)), file);
+        }
+    }
+    for (uint32_t line = 0; line < heatmap->lineCount; line++) {
+        for (int kind = 0; kind < HEAT_KINDS; kind++) {
+            for (int b = 0; b < 8; b++) {
+                fputc((uint8_t)(heatmap->counts[line][kind] >> (b * 8)), file);
+            }
+        }
+    }
+    return 0;
+}
+
+// Writes CSV if the path ends in .csv, the binary format otherwise
+int exportHeatmap(const Heatmap *heatmap, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        error("Failed to open heatmap file: %s", path);
+        return -1;
+    }
+    size_t length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".csv") == 0) {
+        exportCSV(heatmap, file);
+    } else {
+        exportBinary(heatmap, file);
+    }
+    if (ferror(file) | fclose(file)) {
+        error("Failed to write heatmap file: %s", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void printRegion(const char *region, uint32_t bank, const uint64_t *totals,
+                        uint32_t hotLines) {
+    if (!totals[HEAT_READ] && !totals[HEAT_WRITE] && !totals[HEAT_EXECUTE]) {
+        return;
+    }
+    char name[32];
+    if (strcmp(region, "ROM") == 0 || strcmp(region, "Cart RAM") == 0) {
+        snprintf(name, sizeof(name), "%s bank %u", region, bank);
+    } else {
+        snprintf(name, sizeof(name), "%s", region);
+    }
+    info("%-16s reads %12llu  writes %12llu  executes %12llu  lines touched %u", name,
+         (unsigned long long)totals[HEAT_READ], (unsigned long long)totals[HEAT_WRITE],
+         (unsigned long long)totals[HEAT_EXECUTE], hotLines);
+}
+
+// Totals per region; lines of a region are contiguous in the layout
+void printHeatmapSummary(const Heatmap *heatmap) {
+    const char *current = NULL;
+    uint32_t currentBank = 0, hotLines = 0;
+    uint64_t totals[HEAT_KINDS] = { 0 };
+
+    for (uint32_t line = 0; line < heatmap->lineCount; line++) {
+        uint32_t bank;
+        uint16_t address;
+        const char *region = lineRegion(heatmap, line, &bank, &address);
+        if (region != current || bank != currentBank) {
+            if (current) {
+                printRegion(current, currentBank, totals, hotLines);
+            }
+            current = region;
+            currentBank = bank;
+            hotLines = 0;
+            memset(totals, 0, sizeof(totals));
+        }
+        const uint64_t *counts = heatmap->counts[line];
+        if (counts[HEAT_READ] || counts[HEAT_WRITE] || counts[HEAT_EXECUTE]) {
+            hotLines++;
+        }
+        for (int kind = 0; kind < HEAT_KINDS; kind++) {
+            totals[kind] += counts[kind];
+        }
+    }
+    if (current) {
+        printRegion(current, currentBank, totals, hotLines);
+    }
+}
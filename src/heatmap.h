@@ -0,0 +1,62 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cartridge.h"
+#include "memory.h"
+
+#define HEAT_LINE_SHIFT 4  // Counts are kept per 16-byte line
+#define HEAT_BANK_LINES (ROM_BANK_SIZE >> HEAT_LINE_SHIFT)
+#define HEAT_RAM_LINES (MAX_RAM_BANKS * RAM_BANK_SIZE >> HEAT_LINE_SHIFT)
+#define HEAT_HIGH_LINES (0x8000 >> HEAT_LINE_SHIFT)
+
+typedef enum {
+    HEAT_READ,
+    HEAT_WRITE,
+    HEAT_EXECUTE,
+    HEAT_KINDS
+} HeatKind;
+
+// Lines are laid out as every ROM bank, then every cartridge RAM bank, then
+// 0x8000-0xFFFF as the CPU sees it (its cartridge RAM window stays unused)
+typedef struct Heatmap {
+    uint32_t romBanks;
+    uint32_t ramBase;    // First cartridge RAM line
+    uint32_t highBase;   // First line of 0x8000-0xFFFF
+    uint32_t lineCount;
+    uint64_t (*counts)[HEAT_KINDS];
+} Heatmap;
+
+size_t heatmapBytes(const Cartridge *cartridge);
+Heatmap *createHeatmap(struct Arena *arena, const Cartridge *cartridge);
+void freeHeatmap(struct Arena *arena, Heatmap *heatmap);
+int exportHeatmap(const Heatmap *heatmap, const char *path);
+void printHeatmapSummary(const Heatmap *heatmap);
+
+// Instrumentation is only compiled in with -DHEATMAP (make heatmap);
+// otherwise the hooks expand to nothing
+#ifdef HEATMAP
+static inline void recordHeat(Memory *memory, uint16_t address, HeatKind kind) {
+    Heatmap *heatmap = memory->heatmap;
+    uint32_t line;
+    if (!heatmap) {
+        return;
+    }
+    if (address < 0x8000) {
+        uint32_t bank = address < 0x4000 ? memory->lowBank : memory->romBank;
+        line = (bank * ROM_BANK_SIZE + (address & 0x3FFF)) >> HEAT_LINE_SHIFT;
+    } else if (address >= 0xA000 && address < 0xC000) {
+        line = heatmap->ramBase +
+               ((memory->ramBank * RAM_BANK_SIZE + address - 0xA000) >> HEAT_LINE_SHIFT);
+    } else {
+        line = heatmap->highBase + ((address - 0x8000) >> HEAT_LINE_SHIFT);
+    }
+    heatmap->counts[line][kind]++;
+}
+#define heat(memory, address, kind) recordHeat(memory, address, kind)
+#else
+#define heat(memory, address, kind)
+#endif
+
+#endif
@@ -0,0 +1,27 @@
+#include "hosttime.h"
+#include <time.h>
+#include <errno.h>
+
+uint64_t hostTimeNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Sleeps until an absolute hostTimeNanos() value
+void hostSleepUntilNanos(uint64_t deadline) {
+    struct timespec until = {
+        .tv_sec = deadline / 1000000000ull,
+        .tv_nsec = deadline % 1000000000ull
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+void hostSpinPause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
@@ -0,0 +1,10 @@
+#ifndef HOSTTIME_H
+#define HOSTTIME_H
+
+#include <stdint.h>
+
+uint64_t hostTimeNanos(void);
+void hostSleepUntilNanos(uint64_t deadline);
+void hostSpinPause(void);
+
+#endif
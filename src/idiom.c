@@ -0,0 +1,220 @@
+#include "idiom.h"
+#include "heatmap.h"
+#include "utils.h"
+
+// Short copy and clear loops run natively once their back-edge is taken.
+// The remaining iterations are applied in one go with the same final
+// registers, flags, memory and cycle count the interpreter would produce.
+// Anything touching ROM, I/O, OAM or unmapped space is left to the
+// interpreter.
+
+#define COPY_ITERATION_CYCLES 40  // 8 + 8 + 8 + 4 + 12 (JR taken)
+#define FILL_ITERATION_CYCLES 24  // 8 + 4 + 12 (JR taken)
+#define JR_NOT_TAKEN_SAVING 4     // The final JR falls through in 8 cycles
+
+void initLoopCache(CPU *cpu) {
+    for (int i = 0; i < LOOP_CACHE_SIZE; i++) {
+        cpu->loopCache[i].kind = LOOP_EMPTY;
+    }
+    cpu->acceleratedCycles = 0;
+    cpu->acceleratedLoops = 0;
+    cpu->loopCacheHits = 0;
+    cpu->loopCacheMisses = 0;
+}
+
+static uint8_t *getCounter(CPU *cpu, Register reg) {
+    switch (reg) {
+        case REG_B: return &cpu->b;
+        case REG_C: return &cpu->c;
+        case REG_D: return &cpu->d;
+        case REG_E: return &cpu->e;
+        default: return NULL;
+    }
+}
+
+// DEC B/C/D/E
+static Register counterForOpcode(uint8_t opcode) {
+    switch (opcode) {
+        case 0x05: return REG_B;
+        case 0x0D: return REG_C;
+        case 0x15: return REG_D;
+        case 0x1D: return REG_E;
+        default: return REG_NONE;
+    }
+}
+
+static LoopKind decodeLoop(Memory *memory, uint16_t start, uint16_t branch, Register *counter) {
+    uint16_t length = branch - start;
+    uint8_t body[4];
+    // Only JR NZ stops on the counter reaching zero
+    if ((length != 2 && length != 4) || readByte(memory, branch) != 0x20) {
+        return LOOP_NONE;
+    }
+    for (int i = 0; i < length; i++) {
+        body[i] = readByte(memory, start + i);
+    }
+    *counter = counterForOpcode(body[length - 1]);
+    if (*counter == REG_NONE) {
+        return LOOP_NONE;
+    }
+
+    if (length == 2) {
+        if (body[0] == 0x22) return LOOP_FILL_HLI;
+        if (body[0] == 0x32) return LOOP_FILL_HLD;
+        return LOOP_NONE;
+    }
+    // The copies advance DE, so only B or C can count
+    if (*counter != REG_B && *counter != REG_C) {
+        return LOOP_NONE;
+    }
+    if (body[0] == 0x2A && body[1] == 0x12 && body[2] == 0x13) return LOOP_COPY_HLI_TO_DE;
+    if (body[0] == 0x1A && body[1] == 0x22 && body[2] == 0x13) return LOOP_COPY_DE_TO_HLI;
+    return LOOP_NONE;
+}
+
+// Code in RAM can change under us, so only ROM loops are cached. Nested
+// loops can share a start, so entries are keyed on the closing branch.
+static LoopKind lookupLoop(CPU *cpu, Memory *memory, uint16_t start, uint16_t branch, Register *counter) {
+    if (start >= 0x8000) {
+        cpu->loopCacheMisses++;
+        return decodeLoop(memory, start, branch, counter);
+    }
+
+    uint16_t bank = start < 0x4000 ? memory->lowBank : memory->romBank;
+    LoopCacheEntry *entry = &cpu->loopCache[(branch ^ (bank << 4)) & (LOOP_CACHE_SIZE - 1)];
+    if (entry->kind != LOOP_EMPTY && entry->branch == branch && entry->pc == start &&
+        entry->bank == bank) {
+        cpu->loopCacheHits++;
+        *counter = entry->counter;
+        return entry->kind;
+    }
+
+    cpu->loopCacheMisses++;
+    LoopKind kind = decodeLoop(memory, start, branch, counter);
+    entry->pc = start;
+    entry->branch = branch;
+    entry->bank = bank;
+    entry->kind = kind;
+    entry->counter = *counter;
+    return kind;
+}
+
+// Checks the whole destination up front so a fallback never leaves a
+// partial copy behind; n is at most 256, so two slots at most
+static int prepareDestination(Memory *memory, uint16_t address, uint16_t count) {
+    if ((uint32_t)address + count > HIGH_MEMORY_START) {
+        return 0;
+    }
+    uint16_t last = address + count - 1;
+    return writableMemory(memory, address) && writableMemory(memory, last);
+}
+
+static int sourceReadable(uint16_t address, uint16_t count) {
+    return (uint32_t)address + count <= HIGH_MEMORY_START;
+}
+
+// Byte-at-a-time within slots so overlapping ranges behave like the loop
+static uint8_t copyForward(Memory *memory, uint16_t dest, uint16_t src, uint16_t count) {
+    uint8_t value = 0;
+    while (count) {
+        uint8_t *out = writableMemory(memory, dest);
+        const uint8_t *in = readableMemory(memory, src);
+        uint16_t chunk = count;
+        uint16_t destRoom = MEMORY_PAGE_SIZE - (dest & (MEMORY_PAGE_SIZE - 1));
+        uint16_t srcRoom = MEMORY_PAGE_SIZE - (src & (MEMORY_PAGE_SIZE - 1));
+        if (chunk > destRoom) chunk = destRoom;
+        if (chunk > srcRoom) chunk = srcRoom;
+        for (uint16_t i = 0; i < chunk; i++) {
+            out[i] = value = in[i];
+        }
+        dest += chunk;
+        src += chunk;
+        count -= chunk;
+    }
+    return value;
+}
+
+static void fill(Memory *memory, uint16_t dest, uint8_t value, uint16_t count) {
+    while (count) {
+        uint8_t *out = writableMemory(memory, dest);
+        uint16_t chunk = MEMORY_PAGE_SIZE - (dest & (MEMORY_PAGE_SIZE - 1));
+        if (chunk > count) chunk = count;
+        for (uint16_t i = 0; i < chunk; i++) {
+            out[i] = value;
+        }
+        dest += chunk;
+        count -= chunk;
+    }
+}
+
+// Called after any backward JR at `branch` was taken into cpu->pc
+void accelerateLoop(CPU *cpu, Memory *memory, uint16_t branch) {
+    uint16_t start = cpu->pc;
+    Register reg;
+#ifdef HEATMAP
+    // Interpret every iteration so each access is counted
+    if (memory->heatmap) {
+        return;
+    }
+#endif
+    LoopKind kind = lookupLoop(cpu, memory, start, branch, &reg);
+    if (kind == LOOP_NONE) {
+        return;
+    }
+
+    uint8_t *counter = getCounter(cpu, reg);
+    uint16_t count = *counter;
+    if (count == 0) {
+        return;  // Not reached by a taken JR NZ; leave it to the interpreter
+    }
+    uint16_t hl = (cpu->h << 8) | cpu->l;
+    uint16_t de = (cpu->d << 8) | cpu->e;
+    uint32_t cycles;
+
+    switch (kind) {
+        case LOOP_COPY_HLI_TO_DE:
+            if (!sourceReadable(hl, count) || !prepareDestination(memory, de, count)) return;
+            cpu->a = copyForward(memory, de, hl, count);
+            hl += count;
+            de += count;
+            cycles = count * COPY_ITERATION_CYCLES;
+            break;
+        case LOOP_COPY_DE_TO_HLI:
+            if (!sourceReadable(de, count) || !prepareDestination(memory, hl, count)) return;
+            cpu->a = copyForward(memory, hl, de, count);
+            hl += count;
+            de += count;
+            cycles = count * COPY_ITERATION_CYCLES;
+            break;
+        case LOOP_FILL_HLI:
+            if (!prepareDestination(memory, hl, count)) return;
+            fill(memory, hl, cpu->a, count);
+            hl += count;
+            cycles = count * FILL_ITERATION_CYCLES;
+            break;
+        case LOOP_FILL_HLD:
+            if (hl < count - 1 || !prepareDestination(memory, hl - (count - 1), count)) return;
+            fill(memory, hl - (count - 1), cpu->a, count);
+            hl -= count;
+            cycles = count * FILL_ITERATION_CYCLES;
+            break;
+        default:
+            return;
+    }
+
+    // Final DEC reached zero: Z and N set, H clear, C untouched
+    *counter = 0;
+    cpu->f = (cpu->f & 0x10) | 0xC0;
+    cpu->h = hl >> 8;
+    cpu->l = hl & 0xFF;
+    if (kind == LOOP_COPY_HLI_TO_DE || kind == LOOP_COPY_DE_TO_HLI) {
+        cpu->d = de >> 8;
+        cpu->e = de & 0xFF;
+    }
+    cpu->pc = branch + 2;
+    cycles -= JR_NOT_TAKEN_SAVING;
+    addCycles(&cpu->timer, cycles);
+    cpu->acceleratedCycles += cycles;
+    cpu->acceleratedLoops++;
+    p_instr("Accelerated loop at 0x%04X: %u iterations, %u cycles", start, count, cycles);
+}
@@ -0,0 +1,20 @@
+#ifndef IDIOM_H
+#define IDIOM_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "memory.h"
+
+typedef enum {
+    LOOP_EMPTY,          // Cache slot never filled
+    LOOP_NONE,           // Not a recognized idiom
+    LOOP_COPY_HLI_TO_DE, // LD A,(HL+); LD (DE),A; INC DE; DEC r; JR NZ
+    LOOP_COPY_DE_TO_HLI, // LD A,(DE); LD (HL+),A; INC DE; DEC r; JR NZ
+    LOOP_FILL_HLI,       // LD (HL+),A; DEC r; JR NZ
+    LOOP_FILL_HLD        // LD (HL-),A; DEC r; JR NZ
+} LoopKind;
+
+void initLoopCache(CPU *cpu);
+void accelerateLoop(CPU *cpu, Memory *memory, uint16_t branch);
+
+#endif
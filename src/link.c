@@ -0,0 +1,256 @@
+#include "link.h"
+#include "hosttime.h"
+#include "utils.h"
+#include <sched.h>
+#include <string.h>
+
+// Two instances stay deterministic by exchanging bytes at fixed emulated
+// times. A transfer started at cycle t completes at t + SERIAL_TRANSFER_CYCLES
+// on both sides, so neither side may run further ahead of the other's
+// published clock than that. Clocks are only published at slice edges.
+
+static int pushMessage(LinkChannel *channel, LinkMessage message) {
+    unsigned head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&channel->tail, memory_order_acquire);
+    if (head - tail == LINK_CHANNEL_SIZE) {
+        return -1;
+    }
+    channel->messages[head & (LINK_CHANNEL_SIZE - 1)] = message;
+    atomic_store_explicit(&channel->head, head + 1, memory_order_release);
+    return 0;
+}
+
+static int popMessage(LinkChannel *channel, LinkMessage *message) {
+    unsigned tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&channel->head, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+    *message = channel->messages[tail & (LINK_CHANNEL_SIZE - 1)];
+    atomic_store_explicit(&channel->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static void initPort(LinkPort *port, LinkChannel *out, LinkChannel *in,
+                     _Atomic uint64_t *clock, _Atomic uint64_t *peerClock) {
+    port->out = out;
+    port->in = in;
+    port->clock = clock;
+    port->peerClock = peerClock;
+    port->pendingCount = 0;
+    port->awaitingReply = 0;
+    port->replyAt = 0;
+    port->transfers = 0;
+    port->stallTimeout = 0;
+}
+
+void connectLinkCable(LinkCable *cable, GameBoy *first, GameBoy *second) {
+    for (int i = 0; i < 2; i++) {
+        atomic_init(&cable->channels[i].head, 0);
+        atomic_init(&cable->channels[i].tail, 0);
+    }
+    atomic_init(&cable->clocks[0], first->cpu.timer.cycleCount);
+    atomic_init(&cable->clocks[1], second->cpu.timer.cycleCount);
+    initPort(&cable->ports[0], &cable->channels[0], &cable->channels[1],
+             &cable->clocks[0], &cable->clocks[1]);
+    initPort(&cable->ports[1], &cable->channels[1], &cable->channels[0],
+             &cable->clocks[1], &cable->clocks[0]);
+    first->link = &cable->ports[0];
+    second->link = &cable->ports[1];
+    debug("Link cable connected");
+}
+
+// Off by default, since giving up on a peer depends on host timing and so
+// breaks determinism; see waitLinkedUntil
+void setLinkStallTimeout(GameBoy *gameBoy, uint64_t nanos) {
+    if (gameBoy->link) {
+        gameBoy->link->stallTimeout = nanos;
+    }
+}
+
+static void completeTransfer(GameBoy *gameBoy, uint8_t data) {
+    Memory *memory = &gameBoy->memory;
+    memory->high[SERIAL_DATA - HIGH_MEMORY_START] = data;
+    memory->high[SERIAL_CONTROL - HIGH_MEMORY_START] &= 0x7F;
+    memory->high[INTERRUPT_FLAG - HIGH_MEMORY_START] |= INTERRUPT_SERIAL;
+}
+
+// Lets the peer run freely; transfers in flight on either side complete
+// with 0xFF
+void unplugLinkCable(GameBoy *gameBoy) {
+    if (gameBoy->link) {
+        if (gameBoy->link->awaitingReply) {
+            completeTransfer(gameBoy, 0xFF);
+        }
+        atomic_store_explicit(gameBoy->link->clock, UINT64_MAX, memory_order_release);
+        gameBoy->link = NULL;
+    }
+}
+
+static void startTransfer(GameBoy *gameBoy, uint64_t now) {
+    LinkPort *port = gameBoy->link;
+    gameBoy->memory.serialRequest = 0;
+    if (port->awaitingReply) {
+        return;
+    }
+    LinkMessage message = {
+        .time = now + SERIAL_TRANSFER_CYCLES,
+        .type = LINK_TRANSFER,
+        .data = gameBoy->memory.high[SERIAL_DATA - HIGH_MEMORY_START]
+    };
+    if (pushMessage(port->out, message) != 0) {
+        error("Link channel full, dropping transfer");
+        return;
+    }
+    port->awaitingReply = 1;
+    port->replyAt = message.time;
+}
+
+// The externally clocked side swaps its SB for the incoming byte; a side that
+// is not listening shifts in the byte without answering
+static void deliverMessage(GameBoy *gameBoy, LinkMessage message) {
+    LinkPort *port = gameBoy->link;
+    Memory *memory = &gameBoy->memory;
+
+    if (message.type == LINK_REPLY) {
+        completeTransfer(gameBoy, message.data);
+        port->awaitingReply = 0;
+        port->transfers++;
+        return;
+    }
+
+    LinkMessage reply = { .time = message.time, .type = LINK_REPLY, .data = 0xFF };
+    uint8_t control = memory->high[SERIAL_CONTROL - HIGH_MEMORY_START];
+    if ((control & 0x81) == 0x80) {
+        reply.data = memory->high[SERIAL_DATA - HIGH_MEMORY_START];
+        completeTransfer(gameBoy, message.data);
+    }
+    if (pushMessage(port->out, reply) != 0) {
+        error("Link channel full, dropping reply");
+    }
+}
+
+static void deliverDueMessages(GameBoy *gameBoy, uint64_t now) {
+    LinkPort *port = gameBoy->link;
+    LinkMessage message;
+
+    while (port->pendingCount < LINK_PENDING_SIZE && popMessage(port->in, &message)) {
+        port->pending[port->pendingCount++] = message;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < port->pendingCount; i++) {
+        if (port->pending[i].time <= now) {
+            deliverMessage(gameBoy, port->pending[i]);
+        } else {
+            port->pending[kept++] = port->pending[i];
+        }
+    }
+    port->pendingCount = kept;
+}
+
+// Runs until `end` or until the peer has to catch up. Returns 1 once `end`
+// is reached and 0 if blocked, in which case the caller lets the peer run.
+int runLinkedUntil(GameBoy *gameBoy, uint64_t end) {
+    LinkPort *port = gameBoy->link;
+    CPU *cpu = &gameBoy->cpu;
+    Memory *memory = &gameBoy->memory;
+
+    for (;;) {
+        uint64_t now = cpu->timer.cycleCount;
+        // Anything the peer sent before publishing this clock is now visible
+        uint64_t peer = atomic_load_explicit(port->peerClock, memory_order_acquire);
+        deliverDueMessages(gameBoy, now);
+
+        if (port->awaitingReply && now >= port->replyAt) {
+            if (peer != UINT64_MAX) {
+                atomic_store_explicit(port->clock, now, memory_order_release);
+                return 0;
+            }
+            completeTransfer(gameBoy, 0xFF);
+            port->awaitingReply = 0;
+        }
+        if (now >= end) {
+            atomic_store_explicit(port->clock, now, memory_order_release);
+            return 1;
+        }
+
+        uint64_t stop = end;
+        if (peer != UINT64_MAX && peer + SERIAL_TRANSFER_CYCLES < stop) {
+            stop = peer + SERIAL_TRANSFER_CYCLES;
+        }
+        if (port->awaitingReply && port->replyAt < stop) {
+            stop = port->replyAt;
+        }
+        for (int i = 0; i < port->pendingCount; i++) {
+            if (port->pending[i].time < stop) {
+                stop = port->pending[i].time;
+            }
+        }
+        if (now >= stop) {
+            atomic_store_explicit(port->clock, now, memory_order_release);
+            return 0;
+        }
+
+        uint64_t executed = 0;
+        while (cpu->timer.cycleCount < stop) {
+            if (cpu->halted) {
+                cpu->timer.cycleCount = stop;
+                break;
+            }
+            executeNextInstruction(cpu, memory);
+            executed++;
+            if (memory->serialRequest) {
+                startTransfer(gameBoy, cpu->timer.cycleCount);
+                if (port->awaitingReply && port->replyAt < stop) {
+                    stop = port->replyAt;
+                }
+            }
+        }
+        cpu->instructions += executed;
+        atomic_store_explicit(port->clock, cpu->timer.cycleCount, memory_order_release);
+    }
+}
+
+// Runs until `end` while another thread drives the peer. Returns -1 if a
+// stall timeout is set and the peer's clock stops moving for longer than
+// that; the instance is left where it was blocked, so the caller can either
+// wait again or unplug the cable and carry on alone.
+int waitLinkedUntil(GameBoy *gameBoy, uint64_t end) {
+    LinkPort *port = gameBoy->link;
+    uint64_t peer = atomic_load_explicit(port->peerClock, memory_order_acquire);
+    uint64_t stalledSince = 0;
+
+    while (!runLinkedUntil(gameBoy, end)) {
+        uint64_t now = atomic_load_explicit(port->peerClock, memory_order_acquire);
+        if (now != peer || !port->stallTimeout) {
+            peer = now;
+            stalledSince = 0;
+        } else if (!stalledSince) {
+            stalledSince = hostTimeNanos();
+        } else if (hostTimeNanos() - stalledSince > port->stallTimeout) {
+            return -1;
+        }
+        sched_yield();
+    }
+    return 0;
+}
+
+// Steps both ends of a cable through one frame on the calling thread
+void runLinkedFrame(GameBoy *first, GameBoy *second) {
+    uint64_t firstEnd = first->frameStart + CYCLES_PER_FRAME;
+    uint64_t secondEnd = second->frameStart + CYCLES_PER_FRAME;
+    int firstDone = 0, secondDone = 0;
+
+    while (!firstDone || !secondDone) {
+        if (!firstDone) firstDone = runLinkedUntil(first, firstEnd);
+        if (!secondDone) secondDone = runLinkedUntil(second, secondEnd);
+    }
+
+    first->frameStart = firstEnd;
+    first->frames++;
+    realignGameBoyFrame(first);
+    second->frameStart = secondEnd;
+    second->frames++;
+    realignGameBoyFrame(second);
+}
@@ -0,0 +1,58 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "config.h"
+#include "gameboy.h"
+
+#define LINK_CHANNEL_SIZE 16  // Power of two; at most two messages are ever in flight
+#define LINK_PENDING_SIZE 4
+#define SERIAL_TRANSFER_CYCLES 4096  // 8 bits at 8192 Hz
+#define LINK_PEER_TIMEOUT_NANOS 1000000000ull  // Stall timeout for front ends that opt into one
+
+typedef enum {
+    LINK_TRANSFER,  // Master clocked out a byte
+    LINK_REPLY      // Byte shifted back in by the other side
+} LinkMessageType;
+
+typedef struct {
+    uint64_t time;  // Cycle at which the transfer completes on both sides
+    uint8_t type;
+    uint8_t data;
+} LinkMessage;
+
+// Lock-free single producer, single consumer ring
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint head;  // Written by the producer only
+    _Alignas(CACHE_LINE_SIZE) atomic_uint tail;  // Written by the consumer only
+    LinkMessage messages[LINK_CHANNEL_SIZE];
+} LinkChannel;
+
+typedef struct LinkPort {
+    LinkChannel *out;
+    LinkChannel *in;
+    _Atomic uint64_t *clock;       // Our published cycle count
+    _Atomic uint64_t *peerClock;   // Peer cycle count, UINT64_MAX once unplugged
+    LinkMessage pending[LINK_PENDING_SIZE];  // Received, not yet due
+    int pendingCount;
+    int awaitingReply;             // Our transfer is waiting for the peer's byte
+    uint64_t replyAt;
+    uint32_t transfers;            // Completed transfers started by this side
+    uint64_t stallTimeout;         // Host nanoseconds to wait on a stalled peer, 0 for ever
+} LinkPort;
+
+typedef struct {
+    LinkChannel channels[2];
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t clocks[2];
+    LinkPort ports[2];
+} LinkCable;
+
+void connectLinkCable(LinkCable *cable, GameBoy *first, GameBoy *second);
+void unplugLinkCable(GameBoy *gameBoy);
+void setLinkStallTimeout(GameBoy *gameBoy, uint64_t nanos);
+int runLinkedUntil(GameBoy *gameBoy, uint64_t end);
+int waitLinkedUntil(GameBoy *gameBoy, uint64_t end);
+void runLinkedFrame(GameBoy *first, GameBoy *second);
+
+#endif
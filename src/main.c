@@ -1,17 +1,138 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include "arena.h"
+#include "framestream.h"
 #include "gameboy.h"
+#include "harness.h"
+#include "heatmap.h"
+#include "hosttime.h"
+#include "link.h"
+#include "movie.h"
+#include "pacer.h"
+#include "runahead.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 
 typedef enum {
     HELP,
     STEP,
     RUN,
+    RUNAHEAD,
+    FORK,
+    LINK,
+    TEST,
+    DIFF,
     INVALID
 } Command;
 
-Command validargs(int argc, char *argv[], int *cycles, char **romPath) {
+typedef struct {
+    int cycles;
+    char *romPath;
+    RunAheadMode runAheadMode;
+    uint32_t frameLimit; // Host frames for -a, 0 to run until stopped
+    PaceMode paceMode;
+    double speed;
+    char *histogramPath;
+    char *recordPath;
+    char *playPath;
+    long seekFrame;      // Movie frame to start playback at, -1 for none
+    char *heatmapPath;
+    int publishStats;    // Export live counters through a shared memory page
+    char *savePath;      // Battery RAM file, defaults to the ROM path with .sav
+    char *framesOut;     // File descriptor number or path for rendered frames
+    int syncFrames;      // Pace to the reader of framesOut instead of the clock
+    FrameFormat frameFormat;
+    PPUEngine ppuEngine;
+    HarnessOptions harness;
+    char *tracePath;     // Reference log for -d, "-" for stdin
+    uint64_t traceLimit; // Records to compare, 0 for the whole log
+} Options;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signal) {
+    (void)signal;
+    stopRequested = 1;
+}
+
+// Options accepted after the ROM file of -r
+static int parseRunOptions(int argc, char *argv[], int first, Options *options) {
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--turbo") == 0) {
+            options->paceMode = PACE_TURBO;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            options->speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--histogram") == 0 && i + 1 < argc) {
+            options->histogramPath = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            options->recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            options->playPath = argv[++i];
+        } else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+            options->seekFrame = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            options->heatmapPath = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options->publishStats = 1;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            options->savePath = argv[++i];
+        } else if (strcmp(argv[i], "--frames-out") == 0 && i + 1 < argc) {
+            options->framesOut = argv[++i];
+        } else if (strcmp(argv[i], "--sync-frames") == 0) {
+            options->syncFrames = 1;
+        } else if (strcmp(argv[i], "--frames-format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "raw") == 0) {
+                options->frameFormat = FRAMES_RAW;
+            } else if (strcmp(argv[i], "delta") == 0) {
+                options->frameFormat = FRAMES_DELTA;
+            } else {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--ppu") == 0 && i + 1 < argc) {
+            if (parsePPUEngine(argv[++i], &options->ppuEngine) != 0) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    if ((options->recordPath && options->playPath) ||
+        (options->seekFrame >= 0 && !options->playPath) ||
+        (options->syncFrames && !options->framesOut)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Options accepted after the directory of -t
+static int parseTestOptions(int argc, char *argv[], int first, Options *options) {
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            options->harness.budget = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options->harness.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            options->harness.reportPath = argv[++i];
+        } else if (strcmp(argv[i], "--ppu") == 0 && i + 1 < argc) {
+            if (parsePPUEngine(argv[++i], &options->harness.ppuEngine) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--compare-ppu") == 0) {
+            options->harness.comparePPU = 1;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+Command validargs(int argc, char *argv[], Options *options) {
     if (argc < 2) {
         return INVALID;
     }
@@ -20,29 +141,391 @@ Command validargs(int argc, char *argv[], int *cycles, char **romPath) {
         return HELP;
     } else if (strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "--step") == 0) {
         if (argc >= 4) {
-            *cycles = atoi(argv[2]);
-            *romPath = argv[3];
+            options->cycles = atoi(argv[2]);
+            options->romPath = argv[3];
             return STEP;
         } else {
             return INVALID;
         }
     } else if (strcmp(argv[1], "-r") == 0 || strcmp(argv[1], "--run") == 0) {
-        if (argc >= 3) {
-            *romPath = argv[2]; 
+        if (argc >= 3 && parseRunOptions(argc, argv, 3, options) == 0) {
+            options->romPath = argv[2]; 
             return RUN;
         } else {
             return INVALID;
         }
+    } else if (strcmp(argv[1], "-a") == 0 || strcmp(argv[1], "--run-ahead") == 0) {
+        if (argc >= 4) {
+            options->cycles = atoi(argv[2]);
+            options->romPath = argv[3];
+            for (int i = 4; i < argc; i++) {
+                if (strcmp(argv[i], "--second-instance") == 0) {
+                    options->runAheadMode = RUNAHEAD_SECOND_INSTANCE;
+                } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+                    options->frameLimit = strtoul(argv[++i], NULL, 10);
+                } else {
+                    return INVALID;
+                }
+            }
+            return RUNAHEAD;
+        } else {
+            return INVALID;
+        }
+    } else if (strcmp(argv[1], "-f") == 0 || strcmp(argv[1], "--fork") == 0) {
+        if (argc >= 4) {
+            options->cycles = atoi(argv[2]);
+            options->romPath = argv[3];
+            return FORK;
+        } else {
+            return INVALID;
+        }
+    } else if (strcmp(argv[1], "-l") == 0 || strcmp(argv[1], "--link") == 0) {
+        if (argc >= 4) {
+            options->cycles = atoi(argv[2]);
+            options->romPath = argv[3];
+            return LINK;
+        } else {
+            return INVALID;
+        }
+    } else if (strcmp(argv[1], "-t") == 0 || strcmp(argv[1], "--test") == 0) {
+        if (argc >= 3 && parseTestOptions(argc, argv, 3, options) == 0) {
+            options->romPath = argv[2];
+            return TEST;
+        } else {
+            return INVALID;
+        }
+    } else if (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "--diff") == 0) {
+        if (argc == 4 || (argc == 6 && strcmp(argv[4], "--limit") == 0)) {
+            options->tracePath = argv[2];
+            options->romPath = argv[3];
+            options->traceLimit = argc == 6 ? strtoull(argv[5], NULL, 10) : 0;
+            return DIFF;
+        } else {
+            return INVALID;
+        }
     } else {
         return INVALID;
     }
 }
 
+// The ROM is loaded first so the instance's arena can reserve room for a
+// heatmap of its size. `forks` is how many forks will be alive at once, 0
+// for the default.
+static int startGameBoy(GameBoy *gameBoy, const char *romPath, int withHeatmap, uint32_t forks) {
+    Cartridge *cartridge = loadCartridge(romPath);
+    if (!cartridge) {
+        error("Failed to load ROM");
+        return -1;
+    }
+    ArenaConfig config = { .forks = forks, .objectBytes = withHeatmap ? heatmapBytes(cartridge) : 0 };
+    Arena *arena = createArena(&config);
+    int result = arena ? initGameBoy(gameBoy, arena) : -1;
+    releaseArena(arena);  // The instance holds its own reference now
+    if (result != 0) {
+        error("Failed to initialize Game Boy");
+        releaseCartridge(cartridge);
+        return -1;
+    }
+    insertGameBoyCartridge(gameBoy, cartridge);
+    releaseCartridge(cartridge);
+    return 0;
+}
+
+// Backs battery cartridge RAM with a save file next to the ROM. Movie
+// playback restores its own cartridge RAM and leaves the save alone.
+static int attachSaveFile(GameBoy *gameBoy, const Options *options) {
+    Cartridge *cartridge = gameBoy->memory.cartridge;
+    if (!cartridge->hasBattery || options->playPath) {
+        return 0;
+    }
+    if (options->savePath) {
+        return attachBattery(&gameBoy->memory, options->savePath);
+    }
+
+    char savePath[4096];
+    const char *extension = strrchr(options->romPath, '.');
+    const char *slash = strrchr(options->romPath, '/');
+    int length = extension && (!slash || extension > slash)
+        ? (int)(extension - options->romPath) : (int)strlen(options->romPath);
+    if (snprintf(savePath, sizeof(savePath), "%.*s.sav", length, options->romPath) >= (int)sizeof(savePath)) {
+        error("ROM path too long for a save file");
+        return -1;
+    }
+    return attachBattery(&gameBoy->memory, savePath);
+}
+
+// Forks `count` children off one frame of emulation, runs each child for a
+// frame and reports clone latency and per-fork resident memory. Children
+// are headless, as search forks are: nobody looks at their pictures.
+static int forkBenchmark(GameBoy *gameBoy, int count) {
+    GameBoy *children = aligned_alloc(CACHE_LINE_SIZE, sizeof(GameBoy) * (count > 0 ? count : 1));
+    if (!children) {
+        error("Failed to allocate %d forks", count);
+        return -1;
+    }
+
+    // Fault the slots in first, so the timing covers the fork and not the kernel
+    memset(children, 0, sizeof(GameBoy) * (count > 0 ? count : 1));
+    runGameBoyFrame(gameBoy);
+    uint64_t start = hostTimeNanos();
+    for (int i = 0; i < count; i++) {
+        forkGameBoy(&children[i], gameBoy);
+    }
+    uint64_t forkNanos = hostTimeNanos() - start;
+
+    uint64_t residentBytes = 0;
+    uint64_t pageCopies = 0;
+    for (int i = 0; i < count; i++) {
+        setGameBoyHeadless(&children[i]);
+        setGameBoyInput(&children[i], (uint8_t)i);
+        runGameBoyFrame(&children[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        residentBytes += gameBoyResidentBytes(&children[i]);
+        pageCopies += children[i].memory.pageCopies;
+    }
+
+    if (count > 0) {
+        info("Forks: %d, clone latency %.1f ns, resident %.1f KB per live fork, %.2f pages copied per fork",
+             count, (double)forkNanos / count, residentBytes / 1024.0 / count,
+             (double)pageCopies / count);
+    }
+    for (int i = 0; i < count; i++) {
+        freeGameBoy(&children[i]);
+    }
+    free(children);
+    return 0;
+}
+
+typedef struct {
+    GameBoy gameBoy;
+    int frames;
+} LinkedRun;
+
+// A peer that stops running is unplugged, and the frame finished alone
+static void *runLinkedThread(void *arg) {
+    LinkedRun *run = arg;
+    setLinkStallTimeout(&run->gameBoy, LINK_PEER_TIMEOUT_NANOS);
+    for (int i = 0; i < run->frames; i++) {
+        if (runGameBoyFrame(&run->gameBoy) != 0) {
+            error("Link peer stalled in frame %d, unplugging", i);
+            unplugLinkCable(&run->gameBoy);
+            runGameBoyFrame(&run->gameBoy);
+        }
+    }
+    unplugLinkCable(&run->gameBoy);
+    return NULL;
+}
+
+// Runs two linked instances of the same cartridge on their own threads and
+// compares their speed against a single unlinked instance
+static int linkBenchmark(const char *romPath, int frames) {
+    static LinkedRun runs[2];
+    static LinkCable cable;
+    Cartridge *cartridge = loadCartridge(romPath);
+    if (!cartridge) {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (initGameBoy(&runs[i].gameBoy, NULL) != 0) {
+            if (i) {
+                freeGameBoy(&runs[0].gameBoy);
+            }
+            releaseCartridge(cartridge);
+            return -1;
+        }
+        insertGameBoyCartridge(&runs[i].gameBoy, cartridge);
+        runs[i].frames = frames;
+    }
+
+    uint64_t start = hostTimeNanos();
+    for (int i = 0; i < frames; i++) {
+        runGameBoyFrame(&runs[0].gameBoy);
+    }
+    uint64_t unlinkedNanos = hostTimeNanos() - start;
+    freeGameBoy(&runs[0].gameBoy);
+    if (initGameBoy(&runs[0].gameBoy, NULL) != 0) {
+        freeGameBoy(&runs[1].gameBoy);
+        releaseCartridge(cartridge);
+        return -1;
+    }
+    insertGameBoyCartridge(&runs[0].gameBoy, cartridge);
+    releaseCartridge(cartridge);
+
+    connectLinkCable(&cable, &runs[0].gameBoy, &runs[1].gameBoy);
+    pthread_t threads[2];
+    start = hostTimeNanos();
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&threads[i], NULL, runLinkedThread, &runs[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t linkedNanos = hostTimeNanos() - start;
+
+    info("Linked pair: %d frames, %.1f fps per instance (unlinked %.1f fps), transfers %u/%u",
+         frames, frames * 1e9 / linkedNanos, frames * 1e9 / unlinkedNanos,
+         cable.ports[0].transfers, cable.ports[1].transfers);
+    for (int i = 0; i < 2; i++) {
+        freeGameBoy(&runs[i].gameBoy);
+    }
+    return 0;
+}
+
+// Opens the movie requested on the command line, if any, and moves playback
+// to the requested frame
+static int startMovie(Movie *movie, GameBoy *gameBoy, const Options *options) {
+    if (options->recordPath) {
+        return startMovieRecording(movie, options->recordPath, gameBoy);
+    }
+    if (openMovie(movie, options->playPath, gameBoy) != 0) {
+        return -1;
+    }
+    if (options->seekFrame > 0) {
+        uint64_t start = hostTimeNanos();
+        if (seekMovie(movie, gameBoy, (uint32_t)options->seekFrame) != 0) {
+            closeMovie(movie);
+            return -1;
+        }
+        info("Seeked to frame %ld of %u in %.2f ms", options->seekFrame, movie->frameCount,
+             (hostTimeNanos() - start) / 1e6);
+    }
+    return 0;
+}
+
+// Frame stream output not yet taken by its reader, which the pacer treats
+// like queued audio for --sync-frames
+static uint64_t queuedFrameNanos(void *context) {
+    return frameWriterBacklog(context) * FRAME_NANOS;
+}
+
+// Runs frames in real time (or as configured) until interrupted or until the
+// movie being played ends
+static int runPaced(GameBoy *gameBoy, const Options *options) {
+    static Pacer pacer;
+    static FrameWriter frameWriter;
+    int streamFrames = 0;
+    Movie movie;
+    Heatmap *heatmap = NULL;
+    Stats stats = { .page = NULL };
+    int hasMovie = options->recordPath || options->playPath;
+    int status = 0;
+
+    if (options->heatmapPath) {
+#ifdef HEATMAP
+        if (!(heatmap = createHeatmap(gameBoy->memory.arena, gameBoy->memory.cartridge))) {
+            return -1;
+        }
+        gameBoy->memory.heatmap = heatmap;
+#else
+        error("Heatmap support is not compiled in, use build/heatmap/nanoboy from 'make heatmap'");
+        return -1;
+#endif
+    }
+    if (hasMovie && startMovie(&movie, gameBoy, options) != 0) {
+        freeHeatmap(gameBoy->memory.arena, heatmap);
+        return -1;
+    }
+    if (options->framesOut) {
+        if (startFrameWriter(&frameWriter, options->framesOut, options->frameFormat) != 0) {
+            if (hasMovie) closeMovie(&movie);
+            freeHeatmap(gameBoy->memory.arena, heatmap);
+            return -1;
+        }
+        streamFrames = 1;
+    }
+    if (options->publishStats && openStats(&stats, gameBoy->memory.cartridge->title) == 0) {
+        info("Publishing stats as %d/%u", (int)getpid(), stats.page->instance);
+    }
+    initPacer(&pacer, options->paceMode, options->speed);
+    if (options->syncFrames) {
+        // Keep one frame ready for the reader and wait out the rest
+        setPacerAudioSync(&pacer, queuedFrameNanos, &frameWriter, FRAME_NANOS);
+    }
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    while (gameBoy->running && !stopRequested) {
+        if (options->playPath) {
+            int played = playMovieFrame(&movie, gameBoy);
+            if (played <= 0) {
+                status = played;
+                break;
+            }
+        } else if (options->recordPath && recordMovieFrame(&movie, gameBoy) != 0) {
+            status = -1;
+            break;
+        }
+        if (stats.page) {
+            uint64_t start = hostTimeNanos();
+            runGameBoyFrame(gameBoy);
+            publishStats(&stats, gameBoy, hostTimeNanos() - start);
+        } else {
+            runGameBoyFrame(gameBoy);
+        }
+        if (streamFrames) {
+            memcpy(frameWriterBuffer(&frameWriter), gameBoy->ppu.frame->pixels, FRAME_PIXELS);
+            submitFrame(&frameWriter, gameBoy->frames);
+        }
+        waitForNextFrame(&pacer);
+    }
+    closeStats(&stats);
+    if (streamFrames) {
+        stopFrameWriter(&frameWriter);
+        info("Streamed %llu frames (%llu replaced before output), %.1f KB",
+             (unsigned long long)frameWriter.written, (unsigned long long)frameWriter.dropped,
+             frameWriter.bytes / 1024.0);
+    }
+
+    if (hasMovie) {
+        info("Movie %s at frame %u, %u desyncs", options->playPath ? "played" : "recorded",
+             movie.frame, movie.desyncs);
+        if (closeMovie(&movie) != 0) {
+            status = -1;
+        }
+    }
+    info("Ran %llu frames, %llu cycles accelerated in %u loops",
+         (unsigned long long)pacer.frames, (unsigned long long)gameBoy->cpu.acceleratedCycles,
+         gameBoy->cpu.acceleratedLoops);
+    if (heatmap) {
+        printHeatmapSummary(heatmap);
+        if (exportHeatmap(heatmap, options->heatmapPath) != 0) {
+            status = -1;
+        }
+        freeHeatmap(gameBoy->memory.arena, heatmap);
+    }
+    if (options->histogramPath && dumpPacerHistograms(&pacer, options->histogramPath) != 0) {
+        status = -1;
+    }
+    return status;
+}
+
 int main(int argc, char *argv[]) {
-    int cycles = 0; 
-    char *romPath = NULL;
+    Options options = {
+        .cycles = 0,
+        .romPath = NULL,
+        .runAheadMode = RUNAHEAD_SINGLE,
+        .frameLimit = 0,
+        .paceMode = PACE_REALTIME,
+        .speed = 1.0,
+        .histogramPath = NULL,
+        .recordPath = NULL,
+        .playPath = NULL,
+        .seekFrame = -1,
+        .heatmapPath = NULL,
+        .publishStats = 0,
+        .savePath = NULL,
+        .framesOut = NULL,
+        .syncFrames = 0,
+        .frameFormat = FRAMES_DELTA,
+        .ppuEngine = PPU_SCANLINE,
+        .harness = { .budget = TEST_DEFAULT_BUDGET, .jobs = 0, .reportPath = NULL,
+                     .ppuEngine = PPU_SCANLINE, .comparePPU = 0 },
+        .tracePath = NULL,
+        .traceLimit = 0
+    };
 
-    Command cmd = validargs(argc, argv, &cycles, &romPath);
+    Command cmd = validargs(argc, argv, &options);
 
     switch (cmd) {
         case HELP:
@@ -52,24 +535,94 @@ int main(int argc, char *argv[]) {
         case STEP:
             {
                 GameBoy gameBoy;
-                initGameBoy(&gameBoy);
-                if (loadGameBoyROM(&gameBoy, romPath) != 0) {
-                    error("Failed to load ROM");
+                if (startGameBoy(&gameBoy, options.romPath, 0, 0) != 0) {
                     return EXIT_FAILURE;
                 }
-                stepGameBoy(&gameBoy, cycles);
+                stepGameBoy(&gameBoy, options.cycles);
+                freeGameBoy(&gameBoy);
             }
             break;
 
         case RUN:
             {
                 GameBoy gameBoy;
-                initGameBoy(&gameBoy);
-                if (loadGameBoyROM(&gameBoy, romPath) != 0) {
-                    error("Failed to load ROM");
+                if (startGameBoy(&gameBoy, options.romPath, options.heatmapPath != NULL, 0) != 0) {
+                    return EXIT_FAILURE;
+                }
+                selectPPUEngine(&gameBoy.ppu, options.ppuEngine);
+                if (attachSaveFile(&gameBoy, &options) != 0) {
+                    freeGameBoy(&gameBoy);
+                    return EXIT_FAILURE;
+                }
+                int status = runPaced(&gameBoy, &options);
+                freeGameBoy(&gameBoy);
+                if (status != 0) {
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+
+        case RUNAHEAD:
+            {
+                GameBoy gameBoy;
+                RunAhead runAhead;
+                if (startGameBoy(&gameBoy, options.romPath, 0, 0) != 0) {
+                    return EXIT_FAILURE;
+                }
+                initRunAhead(&runAhead, options.runAheadMode, options.cycles);
+                signal(SIGINT, requestStop);
+                signal(SIGTERM, requestStop);
+                while (gameBoy.running && !stopRequested &&
+                       (!options.frameLimit || runAhead.hostFrames < options.frameLimit)) {
+                    runAheadFrame(&runAhead, &gameBoy, 0, NULL, NULL);
+                    if (runAhead.hostFrames % 60 == 0) {
+                        info("Run-ahead %d frames: +%.3f ms per frame (base %.3f ms)",
+                             runAhead.frames, runAheadCostNanos(&runAhead) / 1e6,
+                             runAhead.frameNanos / 1e6 / runAhead.hostFrames);
+                    }
+                }
+                freeRunAhead(&runAhead);
+                freeGameBoy(&gameBoy);
+            }
+            break;
+
+        case FORK:
+            {
+                GameBoy gameBoy;
+                if (startGameBoy(&gameBoy, options.romPath, 0, options.cycles > 0 ? options.cycles : 0) != 0) {
+                    return EXIT_FAILURE;
+                }
+                int status = forkBenchmark(&gameBoy, options.cycles);
+                freeGameBoy(&gameBoy);
+                if (status != 0) {
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+
+        case LINK:
+            if (linkBenchmark(options.romPath, options.cycles) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case TEST:
+            if (runTestROMs(options.romPath, &options.harness) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case DIFF:
+            {
+                GameBoy gameBoy;
+                if (startGameBoy(&gameBoy, options.romPath, 0, 0) != 0) {
+                    return EXIT_FAILURE;
+                }
+                int status = compareTrace(&gameBoy, options.tracePath, options.traceLimit);
+                freeGameBoy(&gameBoy);
+                if (status != 0) {
                     return EXIT_FAILURE;
                 }
-                runGameBoy(&gameBoy);
             }
             break;
 
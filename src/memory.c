@@ -1,45 +1,512 @@
 #include "memory.h"
+#include "arena.h"
+#include "heatmap.h"
+#include "hosttime.h"
+#include "ppu.h"
 #include "utils.h"
 #include <stdio.h>
-#include <string.h> 
+#include <stdlib.h>
+#include <string.h>
 
-void initMemory(Memory *memory) {
-    memset(memory->data, 0, MEMORY_SIZE);
-    debug("Memory Initialized");
+#define PAGE_OFFSET(address) ((address) & (MEMORY_PAGE_SIZE - 1))
+
+// Backing for RAM that was never written and for unmapped space
+static const uint8_t zeroPage[MEMORY_PAGE_SIZE];
+static const uint8_t openBusPage[MEMORY_PAGE_SIZE] = { [0 ... MEMORY_PAGE_SIZE - 1] = 0xFF };
+
+// Pages come from the arena shared by an instance and its forks
+static MemoryPage *allocPage(Memory *memory) {
+    return takeArenaPage(memory->arena);
 }
 
-uint8_t readByte(Memory *memory, uint16_t address) {
-    return memory->data[address];
+static void releasePage(Memory *memory, MemoryPage *page) {
+    if (page && atomic_fetch_sub(&page->refs, 1) == 1) {
+        returnArenaPage(memory->arena, page);
+    }
 }
 
-uint16_t readWord(Memory *memory, uint16_t address) {
-    return memory->data[address] | (memory->data[address + 1] << 8);
+// RAM page backing a 4KB slot of the address space, or -1 for ROM
+static int pageForSlot(const Memory *memory, int slot) {
+    switch (slot) {
+        case 0x8: case 0x9: return PAGE_VRAM + slot - 0x8;
+        case 0xA: case 0xB: return PAGE_CART_RAM + memory->ramBank * 2 + slot - 0xA;
+        case 0xC: case 0xE: return PAGE_WRAM;
+        case 0xD: case 0xF: return PAGE_WRAM + 1;
+        default: return -1;
+    }
 }
 
-void writeByte(Memory *memory, uint16_t address, uint8_t value) {
-    memory->data[address] = value;
+// Whether a RAM page index is saved to the battery file
+static int batteryBacked(const Memory *memory, int index) {
+    Battery *battery = memory->battery;
+    return battery && index >= PAGE_CART_RAM &&
+           (uint32_t)(index - PAGE_CART_RAM) * MEMORY_PAGE_SIZE < battery->size;
+}
+
+static inline uint32_t batteryBit(int index) {
+    return 1u << (index - PAGE_CART_RAM);
+}
+
+// Rebuilds the slot tables after a bank switch, fork or page copy
+static void mapSlots(Memory *memory) {
+    Cartridge *cartridge = memory->cartridge;
+    for (int slot = 0; slot < 0x8; slot++) {
+        uint32_t bank = slot < 0x4 ? memory->lowBank : memory->romBank;
+        memory->read[slot] = cartridge
+            ? &cartridge->rom[bank * ROM_BANK_SIZE + (slot & 0x3) * MEMORY_PAGE_SIZE]
+            : openBusPage;
+        memory->writable[slot] = NULL;
+    }
+    for (int slot = 0x8; slot < MEMORY_PAGE_COUNT; slot++) {
+        if ((slot == 0xA || slot == 0xB) &&
+            (!cartridge || !cartridge->ramBanks || !memory->ramEnabled)) {
+            memory->read[slot] = openBusPage;
+            memory->writable[slot] = NULL;
+            continue;
+        }
+        int index = pageForSlot(memory, slot);
+        MemoryPage *page = memory->pages[index];
+        memory->read[slot] = page ? page->data : zeroPage;
+        // Battery pages go through unsharePage once per flush to be marked dirty
+        memory->writable[slot] = page && atomic_load(&page->refs) == 1 &&
+            (!batteryBacked(memory, index) || (memory->battery->dirty & batteryBit(index)))
+            ? page->data : NULL;
+    }
 }
 
-int loadROM(Memory *memory, const char *filePath) {
-    FILE *file = fopen(filePath, "rb");
-    if (!file) {
-        error("Failed to open ROM: %s", filePath);
+// Takes a reference on `arena`, or reserves a default one if it is NULL
+int initMemory(Memory *memory, struct Arena *arena) {
+    memory->arena = arena ? retainArena(arena) : createArena(NULL);
+    if (!memory->arena) {
         return -1;
     }
+    memset(memory->high, 0, HIGH_MEMORY_SIZE);
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        memory->pages[i] = NULL;
+    }
+    memory->cartridge = NULL;
+    memory->romBank = 1;
+    memory->lowBank = 0;
+    memory->ramBank = 0;
+    memory->bankHigh = 0;
+    memory->bankMode = 0;
+    memory->ramEnabled = 0;
+    memory->joypad = 0;
+    memory->serialRequest = 0;
+    memory->pageCopies = 0;
+    memory->battery = NULL;
+    memory->ppu = NULL;
+    memory->timer = NULL;
+#ifdef HEATMAP
+    memory->heatmap = NULL;
+#endif
+    mapSlots(memory);
+    debug("Memory Initialized");
+    return 0;
+}
 
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    rewind(file);
+// Writes cartridge RAM back to the save file before letting it go
+static void detachBattery(Memory *memory) {
+    flushBattery(memory, 1);
+    closeBattery(memory->arena, memory->battery);
+    memory->battery = NULL;
+}
 
-    if (fileSize > (MEMORY_SIZE - 0x0100)) {
-        error("ROM size exceeds available memory");
-        fclose(file);
-        return -1;
+void freeMemory(Memory *memory) {
+    detachBattery(memory);
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        releasePage(memory, memory->pages[i]);
+        memory->pages[i] = NULL;
     }
+    releaseCartridge(memory->cartridge);
+    memory->cartridge = NULL;
+    mapSlots(memory);
 
-    fread(&memory->data[0x0100], 1, fileSize, file);
-    fclose(file);
+    // Last, as the instance itself may live in the arena
+    Arena *arena = memory->arena;
+    memory->arena = NULL;
+    releaseArena(arena);
+}
+
+// Shares every page with the child; both sides lose write access until they
+// copy (or, if the other side is gone by then, simply reclaim) the page.
+// Battery-backed cartridge RAM is shared the same way, but the save file
+// stays with the parent, so nothing the child writes ever reaches it.
+void forkMemory(Memory *child, Memory *parent) {
+    child->arena = retainArena(parent->arena);
+    memcpy(child->high, parent->high, HIGH_MEMORY_SIZE);
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        if (parent->pages[i]) {
+            atomic_fetch_add(&parent->pages[i]->refs, 1);
+        }
+        child->pages[i] = parent->pages[i];
+    }
+    child->cartridge = parent->cartridge ? retainCartridge(parent->cartridge) : NULL;
+    child->romBank = parent->romBank;
+    child->lowBank = parent->lowBank;
+    child->ramBank = parent->ramBank;
+    child->bankHigh = parent->bankHigh;
+    child->bankMode = parent->bankMode;
+    child->ramEnabled = parent->ramEnabled;
+    child->joypad = parent->joypad;
+    child->serialRequest = parent->serialRequest;
+    child->pageCopies = 0;
+    child->battery = NULL;
+    child->ppu = NULL;
+    child->timer = NULL;
+#ifdef HEATMAP
+    child->heatmap = parent->heatmap;
+#endif
+    mapSlots(child);
+    for (int slot = 0; slot < MEMORY_PAGE_COUNT; slot++) {
+        parent->writable[slot] = NULL;
+    }
+}
 
-    success("ROM loaded: %s (%ld bytes)", filePath, fileSize);
+// Takes over `snapshot`, a fork of `memory` taken earlier, in place of the
+// current contents. The save file goes with the snapshot if it holds it;
+// otherwise the instance keeps its own and rewrites all of it next flush.
+void restoreMemory(Memory *memory, Memory *snapshot) {
+    struct PPU *ppu = memory->ppu;
+    Timer *timer = memory->timer;
+    Battery *battery = snapshot->battery;
+    if (!battery && (battery = memory->battery)) {
+        memory->battery = NULL;
+        battery->dirty = ~0u;
+    }
+    freeMemory(memory);
+    *memory = *snapshot;
+    memory->battery = battery;
+    memory->ppu = ppu;
+    memory->timer = timer;
+    mapSlots(memory);
+}
+
+// Hands the save file to another instance of the same family, which
+// shares the arena it came from
+void moveBattery(Memory *to, Memory *from) {
+    detachBattery(to);
+    to->battery = from->battery;
+    from->battery = NULL;
+    mapSlots(to);
+    mapSlots(from);
+}
+
+void insertCartridge(Memory *memory, Cartridge *cartridge) {
+    detachBattery(memory);
+    releaseCartridge(memory->cartridge);
+    memory->cartridge = retainCartridge(cartridge);
+    memory->romBank = 1;
+    memory->lowBank = 0;
+    memory->ramBank = 0;
+    memory->bankHigh = 0;
+    memory->bankMode = 0;
+    memory->ramEnabled = cartridge->mbc == MBC_NONE;
+    mapSlots(memory);
+}
+
+// Proportional share: each page counts 1/refs towards every instance using
+// it; the shared ROM is not counted
+uint32_t memoryResidentBytes(const Memory *memory) {
+    uint32_t bytes = sizeof(Memory);
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        if (memory->pages[i]) {
+            bytes += sizeof(MemoryPage) / atomic_load(&memory->pages[i]->refs);
+        }
+    }
+    if (memory->battery) {
+        bytes += memory->battery->size;
+    }
+    return bytes;
+}
+
+// Replaces the contents of a RAM page, NULL dropping it back to the lazy
+// zero page; used when restoring saved state
+int setMemoryPage(Memory *memory, int index, const uint8_t *data) {
+    MemoryPage *page = memory->pages[index];
+    if (!data) {
+        releasePage(memory, page);
+        memory->pages[index] = NULL;
+    } else if (page && atomic_load(&page->refs) == 1) {
+        memcpy(page->data, data, MEMORY_PAGE_SIZE);
+    } else {
+        MemoryPage *copy = allocPage(memory);
+        if (!copy) {
+            error("Failed to allocate memory page %d", index);
+            return -1;
+        }
+        memcpy(copy->data, data, MEMORY_PAGE_SIZE);
+        releasePage(memory, page);
+        memory->pages[index] = copy;
+    }
+    if (batteryBacked(memory, index)) {
+        memory->battery->dirty |= batteryBit(index);
+    }
+    mapSlots(memory);
     return 0;
 }
+
+// Contents of a RAM page for saving state, NULL if never written
+const uint8_t *memoryPageData(const Memory *memory, int index) {
+    return memory->pages[index] ? memory->pages[index]->data : NULL;
+}
+
+// Backs the cartridge RAM with a save file. Its contents replace whatever
+// the instance had in cartridge RAM so far.
+int attachBattery(Memory *memory, const char *savePath) {
+    Cartridge *cartridge = memory->cartridge;
+    if (!cartridge || !cartridge->ramBanks) {
+        error("Cartridge has no RAM to back with %s", savePath);
+        return -1;
+    }
+    Battery *battery = openBattery(memory->arena, savePath, cartridge->ramBanks * RAM_BANK_SIZE);
+    if (!battery) {
+        return -1;
+    }
+    detachBattery(memory);
+    memory->battery = battery;
+    for (int i = PAGE_CART_RAM; i < RAM_PAGE_COUNT; i++) {
+        const uint8_t *data = NULL;
+        uint32_t offset = (uint32_t)(i - PAGE_CART_RAM) * MEMORY_PAGE_SIZE;
+        if (offset < battery->size && memcmp(battery->data + offset, zeroPage, MEMORY_PAGE_SIZE)) {
+            data = battery->data + offset;
+        }
+        if (setMemoryPage(memory, i, data) != 0) {
+            return -1;
+        }
+    }
+    battery->dirty = 0;
+    mapSlots(memory);
+    return 0;
+}
+
+// Copies the pages written since the last flush into the save file and
+// syncs them once the flush interval has passed, or right away if forced.
+// Called once per frame.
+int flushBattery(Memory *memory, int force) {
+    Battery *battery = memory->battery;
+    if (!battery || !battery->dirty) {
+        return 0;
+    }
+    if (!force && hostTimeNanos() - battery->lastFlush < BATTERY_FLUSH_NANOS) {
+        return 0;
+    }
+    for (int i = PAGE_CART_RAM; batteryBacked(memory, i); i++) {
+        if (battery->dirty & batteryBit(i)) {
+            const uint8_t *data = memoryPageData(memory, i);
+            memcpy(battery->data + (i - PAGE_CART_RAM) * MEMORY_PAGE_SIZE,
+                   data ? data : zeroPage, MEMORY_PAGE_SIZE);
+        }
+    }
+    int status = syncBattery(battery);
+    mapSlots(memory);
+    return status;
+}
+
+static uint8_t *unsharePage(Memory *memory, int slot) {
+    int index = pageForSlot(memory, slot);
+    MemoryPage *page = memory->pages[index];
+    if (!page) {
+        if (!(page = allocPage(memory))) {
+            error("Failed to allocate memory page 0x%X", slot);
+            return NULL;
+        }
+        memset(page->data, 0, MEMORY_PAGE_SIZE);
+        memory->pages[index] = page;
+    } else if (atomic_load(&page->refs) > 1) {
+        MemoryPage *copy = allocPage(memory);
+        if (!copy) {
+            error("Failed to copy memory page 0x%X", slot);
+            return NULL;
+        }
+        memcpy(copy->data, page->data, MEMORY_PAGE_SIZE);
+        releasePage(memory, page);
+        memory->pages[index] = page = copy;
+        memory->pageCopies++;
+    }
+    if (batteryBacked(memory, index)) {
+        memory->battery->dirty |= batteryBit(index);
+    }
+    mapSlots(memory);
+    return page->data;
+}
+
+// MBC1 puts its two upper bits on both the ROM and the RAM bank lines. Mode
+// 0 applies them to 0x4000-0x7FFF only; mode 1 also to 0x0000-0x3FFF and
+// to cartridge RAM. Whichever the cartridge does not have is masked off by
+// its size: >512KB ROMs have at most 8KB of RAM and 32KB RAMs come with at
+// most 512KB of ROM.
+static void mapMBC1Banks(Memory *memory, uint8_t low) {
+    Cartridge *cartridge = memory->cartridge;
+    uint32_t high = (uint32_t)memory->bankHigh << 5;
+    memory->romBank = (high | low) % cartridge->romBanks;
+    memory->lowBank = memory->bankMode ? high % cartridge->romBanks : 0;
+    memory->ramBank = memory->bankMode && cartridge->ramBanks
+        ? memory->bankHigh % cartridge->ramBanks : 0;
+}
+
+static void writeBankRegister(Memory *memory, uint16_t address, uint8_t value) {
+    Cartridge *cartridge = memory->cartridge;
+    if (!cartridge || cartridge->mbc == MBC_NONE) {
+        return;
+    }
+
+    if (address < 0x2000) {
+        memory->ramEnabled = (value & 0x0F) == 0x0A;
+    } else if (address < 0x4000) {
+        switch (cartridge->mbc) {
+            case MBC_1:
+                mapMBC1Banks(memory, value & 0x1F ? value & 0x1F : 1);
+                break;
+            case MBC_3:
+                memory->romBank = value & 0x7F ? value & 0x7F : 1;
+                break;
+            case MBC_5:
+                if (address < 0x3000) {
+                    memory->romBank = (memory->romBank & 0x100) | value;
+                } else {
+                    memory->romBank = (memory->romBank & 0xFF) | ((value & 0x01) << 8);
+                }
+                break;
+            default:
+                break;
+        }
+    } else if (address < 0x6000) {
+        if (cartridge->mbc == MBC_1) {
+            memory->bankHigh = value & 0x03;
+            mapMBC1Banks(memory, memory->romBank & 0x1F);
+        } else if (cartridge->ramBanks) {
+            memory->ramBank = (value & 0x0F) % cartridge->ramBanks;
+        }
+    } else if (cartridge->mbc == MBC_1) {
+        memory->bankMode = value & 0x01;
+        mapMBC1Banks(memory, memory->romBank & 0x1F);
+    }
+    memory->romBank %= cartridge->romBanks;
+    mapSlots(memory);
+}
+
+// Registers whose value depends on where the PPU is in the frame
+static inline int isPPUAccess(const Memory *memory, uint16_t address) {
+    return memory->ppu && (address == INTERRUPT_FLAG ||
+                           (address >= PPU_FIRST_REGISTER && address <= PPU_LAST_REGISTER));
+}
+
+// Registers whose value depends on where the timer has counted to
+static inline int isTimerAccess(const Memory *memory, uint16_t address) {
+    return memory->timer && (address == INTERRUPT_FLAG ||
+                             (address >= TIMER_DIVIDER && address <= TIMER_CONTROL));
+}
+
+// Raises IF for any TIMA overflow that has come due
+void updateTimerInterrupt(Memory *memory) {
+    if (catchUpTimer(memory->timer)) {
+        memory->high[INTERRUPT_FLAG - HIGH_MEMORY_START] |= INTERRUPT_TIMER;
+    }
+}
+
+// Copies DIV, TIMA, TMA and TAC into the register file for readers that
+// bypass readByte, such as nanoBoyMemory and save states
+void mirrorTimerRegisters(Memory *memory) {
+    for (uint16_t address = TIMER_DIVIDER; address <= TIMER_CONTROL; address++) {
+        memory->high[address - HIGH_MEMORY_START] = readTimer(memory->timer, address);
+    }
+}
+
+// P1 reads back 0 for every pressed button of the selected group(s)
+static uint8_t readJoypad(Memory *memory) {
+    uint8_t select = memory->high[JOYPAD_REGISTER - HIGH_MEMORY_START];
+    uint8_t pressed = 0;
+    if (!(select & 0x10)) pressed |= memory->joypad & 0x0F;
+    if (!(select & 0x20)) pressed |= memory->joypad >> 4;
+    return (select | 0xCF) & ~pressed;
+}
+
+static inline uint8_t readMemory(Memory *memory, uint16_t address) {
+    if (address < HIGH_MEMORY_START) {
+        return memory->read[address >> MEMORY_PAGE_SHIFT][PAGE_OFFSET(address)];
+    }
+    if (address == JOYPAD_REGISTER) {
+        return readJoypad(memory);
+    }
+    if (isPPUAccess(memory, address)) {
+        runPPU(memory->ppu, memory);
+    }
+    if (isTimerAccess(memory, address)) {
+        updateTimerInterrupt(memory);
+        if (address != INTERRUPT_FLAG) {
+            return readTimer(memory->timer, address);
+        }
+    }
+    return memory->high[address - HIGH_MEMORY_START];
+}
+
+uint8_t readByte(Memory *memory, uint16_t address) {
+    heat(memory, address, HEAT_READ);
+    return readMemory(memory, address);
+}
+
+// Opcode fetch, which the heatmap counts as an execute rather than a read
+uint8_t fetchByte(Memory *memory, uint16_t address) {
+    heat(memory, address, HEAT_EXECUTE);
+    return readMemory(memory, address);
+}
+
+uint16_t readWord(Memory *memory, uint16_t address) {
+    return readByte(memory, address) | (readByte(memory, address + 1) << 8);
+}
+
+void writeByte(Memory *memory, uint16_t address, uint8_t value) {
+    int slot = address >> MEMORY_PAGE_SHIFT;
+    uint8_t *data = memory->writable[slot];
+    heat(memory, address, HEAT_WRITE);
+    if (data && address < HIGH_MEMORY_START) {
+        data[PAGE_OFFSET(address)] = value;
+    } else if (address >= HIGH_MEMORY_START) {
+        if (isTimerAccess(memory, address)) {
+            // Settle IF first so a pending overflow can't undo the write
+            updateTimerInterrupt(memory);
+            if (address != INTERRUPT_FLAG) {
+                if (writeTimer(memory->timer, address, value)) {
+                    memory->high[INTERRUPT_FLAG - HIGH_MEMORY_START] |= INTERRUPT_TIMER;
+                }
+                return;
+            }
+        }
+        if (isPPUAccess(memory, address)) {
+            writePPURegister(memory->ppu, memory, address, value);
+            return;
+        }
+        memory->high[address - HIGH_MEMORY_START] = value;
+        if (address == SERIAL_CONTROL && (value & 0x81) == 0x81) {
+            memory->serialRequest = 1;
+        }
+    } else if (slot < 0x8) {
+        writeBankRegister(memory, address, value);
+    } else if (memory->read[slot] != openBusPage && (data = unsharePage(memory, slot))) {
+        data[PAGE_OFFSET(address)] = value;
+    }
+}
+
+// Direct access for bulk operations, valid up to the end of the 4KB slot.
+// Only plain memory qualifies: nothing at or above 0xFE00 is returned.
+const uint8_t *readableMemory(const Memory *memory, uint16_t address) {
+    if (address >= HIGH_MEMORY_START) {
+        return NULL;
+    }
+    return &memory->read[address >> MEMORY_PAGE_SHIFT][PAGE_OFFSET(address)];
+}
+
+// Also excludes ROM (bank registers) and unmapped cartridge RAM; shared
+// pages are copied first
+uint8_t *writableMemory(Memory *memory, uint16_t address) {
+    int slot = address >> MEMORY_PAGE_SHIFT;
+    if (address >= HIGH_MEMORY_START || slot < 0x8 || memory->read[slot] == openBusPage) {
+        return NULL;
+    }
+    uint8_t *data = memory->writable[slot];
+    if (!data && !(data = unsharePage(memory, slot))) {
+        return NULL;
+    }
+    return &data[PAGE_OFFSET(address)];
+}
@@ -2,16 +2,92 @@
 #define MEMORY_H
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include "config.h"
+#include "cartridge.h"
+#include "battery.h"
+#include "timer.h"
+
+#define JOYPAD_REGISTER 0xFF00
+#define SERIAL_DATA 0xFF01
+#define SERIAL_CONTROL 0xFF02
+#define INTERRUPT_FLAG 0xFF0F
+#define INTERRUPT_SERIAL 0x08
+#define LCD_CONTROL 0xFF40
+#define SCROLL_Y 0xFF42
+#define SCROLL_X 0xFF43
+#define BG_PALETTE 0xFF47
+#define HIGH_MEMORY_START 0xFE00  // OAM, I/O registers and HRAM
+#define HIGH_MEMORY_SIZE 0x0200
+
+// Joypad buttons, set bits mean pressed
+#define JOYPAD_RIGHT  0x01
+#define JOYPAD_LEFT   0x02
+#define JOYPAD_UP     0x04
+#define JOYPAD_DOWN   0x08
+#define JOYPAD_A      0x10
+#define JOYPAD_B      0x20
+#define JOYPAD_SELECT 0x40
+#define JOYPAD_START  0x80
+
+struct Arena;
+
+// Per-instance RAM pages, allocated on first write
+typedef enum {
+    PAGE_VRAM = 0,                         // 0x8000-0x9FFF
+    PAGE_WRAM = 2,                         // 0xC000-0xDFFF, echoed at 0xE000
+    PAGE_CART_RAM = 4,                     // 0xA000-0xBFFF, per RAM bank
+    RAM_PAGE_COUNT = PAGE_CART_RAM + MAX_RAM_BANKS * (RAM_BANK_SIZE / MEMORY_PAGE_SIZE)
+} RAMPage;
+
+// Pages are shared copy-on-write between forked instances
+typedef struct {
+    atomic_uint refs;                // Instances mapping this page
+    uint8_t data[MEMORY_PAGE_SIZE];
+} MemoryPage;
 
 typedef struct {
-    uint8_t data[MEMORY_SIZE];  // 64KB of addressable memory
+    const uint8_t *read[MEMORY_PAGE_COUNT];  // Current mapping of every 4KB slot
+    uint8_t *writable[MEMORY_PAGE_COUNT];    // Slot data if owned exclusively, else NULL
+    uint8_t high[HIGH_MEMORY_SIZE];          // 0xFE00-0xFFFF, always private
+    MemoryPage *pages[RAM_PAGE_COUNT];       // NULL until first written
+    struct Arena *arena;                     // Source of pages, shared with forks
+    Cartridge *cartridge;                    // Shared ROM, NULL if none inserted
+    uint16_t romBank;                        // Bank mapped at 0x4000-0x7FFF
+    uint16_t lowBank;                        // Bank mapped at 0x0000-0x3FFF
+    uint8_t ramBank;                         // Bank mapped at 0xA000-0xBFFF
+    uint8_t bankHigh;                        // MBC1 upper bank bits (0x4000-0x5FFF)
+    uint8_t bankMode;                        // MBC1 mode select (0x6000-0x7FFF)
+    uint8_t ramEnabled;
+    uint8_t joypad;                          // Currently pressed buttons
+    uint8_t serialRequest;                   // SC started an internally clocked transfer
+    uint32_t pageCopies;                     // Pages copied on write so far
+    Battery *battery;                        // Cartridge RAM mapped from a save file
+    struct PPU *ppu;                         // Caught up on LCD register and IF access
+    Timer *timer;                            // Caught up on timer register and IF access
+#ifdef HEATMAP
+    struct Heatmap *heatmap;                 // Access counters, shared with forks
+#endif
 } Memory;
 
-void initMemory(Memory *memory);
+int initMemory(Memory *memory, struct Arena *arena);
+void freeMemory(Memory *memory);
+void forkMemory(Memory *child, Memory *parent);
+void restoreMemory(Memory *memory, Memory *snapshot);
+void moveBattery(Memory *to, Memory *from);
+void insertCartridge(Memory *memory, Cartridge *cartridge);
+uint32_t memoryResidentBytes(const Memory *memory);
+int setMemoryPage(Memory *memory, int index, const uint8_t *data);
+const uint8_t *memoryPageData(const Memory *memory, int index);
+int attachBattery(Memory *memory, const char *savePath);
+int flushBattery(Memory *memory, int force);
 uint8_t readByte(Memory *memory, uint16_t address);
+uint8_t fetchByte(Memory *memory, uint16_t address);
 uint16_t readWord(Memory *memory, uint16_t address);
 void writeByte(Memory *memory, uint16_t address, uint8_t value);
-int loadROM(Memory *memory, const char *filePath);  
+void updateTimerInterrupt(Memory *memory);
+void mirrorTimerRegisters(Memory *memory);
+const uint8_t *readableMemory(const Memory *memory, uint16_t address);
+uint8_t *writableMemory(Memory *memory, uint16_t address);
 
-#endif 
+#endif
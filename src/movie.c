@@ -0,0 +1,421 @@
+#include "movie.h"
+#include "arena.h"
+#include "state.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// File layout, all values little-endian:
+//   header   "NBMV", version u16, keyframe interval u16, ROM title[16],
+//            ROM global checksum u16, 6 reserved bytes
+//   'R'      buttons u8, frames u16             one run of equal input
+//   'K'      frame u32, size u32, hash u64, state[size]
+//   'E'      frames u32, keyframes u32, {frame u32, offset u64}...,
+//            offset of 'E' u64, "NBIX"
+// Runs never span a keyframe, so playback can start at any 'K' record. A
+// movie cut short by a crash has no 'E' record and is indexed by a scan.
+
+#define MOVIE_HEADER_SIZE 32
+#define MOVIE_TRAILER_SIZE 12
+#define MOVIE_RUN_MAX 0xFFFF
+
+static int writeValue(FILE *file, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        if (fputc((uint8_t)(value >> (i * 8)), file) == EOF) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int readValue(FILE *file, int bytes, uint64_t *value) {
+    *value = 0;
+    for (int i = 0; i < bytes; i++) {
+        int c = fgetc(file);
+        if (c == EOF) {
+            return -1;
+        }
+        *value |= (uint64_t)c << (i * 8);
+    }
+    return 0;
+}
+
+static uint16_t romChecksum(const Cartridge *cartridge) {
+    return (cartridge->rom[0x014E] << 8) | cartridge->rom[0x014F];
+}
+
+static void freeMovie(Movie *movie) {
+    if (movie->file) {
+        fclose(movie->file);
+        movie->file = NULL;
+    }
+    freeArenaObject(movie->arena, movie->keyframes,
+                    movie->keyframeCapacity * sizeof(MovieKeyframe));
+    freeArenaObject(movie->arena, movie->state, STATE_MAX_SIZE);
+    releaseArena(movie->arena);
+    movie->keyframes = NULL;
+    movie->state = NULL;
+    movie->arena = NULL;
+}
+
+// The state buffer and the index come from the instance's arena, so
+// recording and playback stay off the heap
+static int initMovie(Movie *movie, MovieMode mode, GameBoy *gameBoy) {
+    movie->file = NULL;
+    movie->arena = retainArena(gameBoy->memory.arena);
+    movie->mode = mode;
+    movie->frame = 0;
+    movie->frameCount = 0;
+    movie->interval = MOVIE_KEYFRAME_INTERVAL;
+    movie->runButtons = 0;
+    movie->runLength = 0;
+    movie->keyframeCount = 0;
+    movie->keyframeCapacity = MOVIE_INDEX_RESERVE;
+    movie->desyncs = 0;
+    movie->keyframes = allocArenaObject(movie->arena, MOVIE_INDEX_RESERVE * sizeof(MovieKeyframe));
+    movie->state = allocArenaObject(movie->arena, STATE_MAX_SIZE);
+    if (!movie->keyframes || !movie->state) {
+        error("Failed to allocate movie buffers");
+        freeMovie(movie);
+        return -1;
+    }
+    return 0;
+}
+
+static int addKeyframe(Movie *movie, uint32_t frame, uint64_t offset) {
+    if (movie->keyframeCount == movie->keyframeCapacity) {
+        uint32_t capacity = movie->keyframeCapacity * 2;
+        MovieKeyframe *keyframes = allocArenaObject(movie->arena, capacity * sizeof(MovieKeyframe));
+        if (!keyframes) {
+            error("Failed to grow movie index");
+            return -1;
+        }
+        memcpy(keyframes, movie->keyframes, movie->keyframeCount * sizeof(MovieKeyframe));
+        freeArenaObject(movie->arena, movie->keyframes,
+                        movie->keyframeCapacity * sizeof(MovieKeyframe));
+        movie->keyframes = keyframes;
+        movie->keyframeCapacity = capacity;
+    }
+    movie->keyframes[movie->keyframeCount++] = (MovieKeyframe){ frame, offset };
+    return 0;
+}
+
+static int flushRun(Movie *movie) {
+    if (movie->runLength == 0) {
+        return 0;
+    }
+    int status = writeValue(movie->file, 'R', 1) | writeValue(movie->file, movie->runButtons, 1) |
+                 writeValue(movie->file, movie->runLength, 2);
+    movie->runLength = 0;
+    return status;
+}
+
+static int writeKeyframe(Movie *movie, const GameBoy *gameBoy) {
+    long offset = ftell(movie->file);
+    uint32_t size = saveGameBoyState(gameBoy, movie->state);
+    if (offset < 0 || addKeyframe(movie, movie->frame, offset) != 0) {
+        return -1;
+    }
+    if (writeValue(movie->file, 'K', 1) | writeValue(movie->file, movie->frame, 4) |
+        writeValue(movie->file, size, 4) |
+        writeValue(movie->file, hashState(movie->state, size), 8) ||
+        fwrite(movie->state, 1, size, movie->file) != size) {
+        return -1;
+    }
+    return 0;
+}
+
+int startMovieRecording(Movie *movie, const char *path, GameBoy *gameBoy) {
+    Cartridge *cartridge = gameBoy->memory.cartridge;
+    if (!cartridge) {
+        error("Cannot record a movie without a cartridge");
+        return -1;
+    }
+    if (initMovie(movie, MOVIE_RECORD, gameBoy) != 0) {
+        return -1;
+    }
+    if (!(movie->file = fopen(path, "wb"))) {
+        error("Failed to create movie file: %s", path);
+        freeMovie(movie);
+        return -1;
+    }
+
+    uint8_t title[16] = { 0 };
+    memcpy(title, cartridge->title, strnlen(cartridge->title, sizeof(title)));
+    fwrite(MOVIE_MAGIC, 1, 4, movie->file);
+    writeValue(movie->file, MOVIE_VERSION, 2);
+    writeValue(movie->file, movie->interval, 2);
+    fwrite(title, 1, sizeof(title), movie->file);
+    writeValue(movie->file, romChecksum(cartridge), 2);
+    writeValue(movie->file, 0, 6);
+    debug("Recording movie to %s", path);
+    return 0;
+}
+
+// Records the input currently applied to the instance; call once per frame
+// before running it
+int recordMovieFrame(Movie *movie, const GameBoy *gameBoy) {
+    uint8_t buttons = gameBoy->memory.joypad;
+    if (movie->frame % movie->interval == 0) {
+        if (flushRun(movie) != 0 || writeKeyframe(movie, gameBoy) != 0) {
+            error("Failed to write movie keyframe");
+            return -1;
+        }
+    }
+    if (movie->runLength && (buttons != movie->runButtons || movie->runLength == MOVIE_RUN_MAX)) {
+        if (flushRun(movie) != 0) {
+            error("Failed to write movie input");
+            return -1;
+        }
+    }
+    movie->runButtons = buttons;
+    movie->runLength++;
+    movie->frame++;
+    return 0;
+}
+
+static int readHeader(Movie *movie, const Cartridge *cartridge) {
+    char magic[4];
+    uint8_t title[16];
+    uint64_t version, interval, checksum, reserved;
+
+    if (fread(magic, 1, 4, movie->file) != 4 || memcmp(magic, MOVIE_MAGIC, 4) != 0 ||
+        readValue(movie->file, 2, &version) != 0 || version != MOVIE_VERSION) {
+        error("Not a supported movie file");
+        return -1;
+    }
+    if (readValue(movie->file, 2, &interval) != 0 || interval == 0 ||
+        fread(title, 1, sizeof(title), movie->file) != sizeof(title) ||
+        readValue(movie->file, 2, &checksum) != 0 || readValue(movie->file, 6, &reserved) != 0) {
+        error("Movie header is truncated");
+        return -1;
+    }
+    if (strncmp((const char *)title, cartridge->title, sizeof(title)) != 0 ||
+        checksum != romChecksum(cartridge)) {
+        error("Movie was recorded with a different ROM");
+        return -1;
+    }
+    movie->interval = interval;
+    return 0;
+}
+
+// Uses the index written when recording finished
+static int readIndex(Movie *movie) {
+    uint64_t offset, value, frames, count;
+    char magic[4];
+
+    if (fseek(movie->file, -MOVIE_TRAILER_SIZE, SEEK_END) != 0 ||
+        readValue(movie->file, 8, &offset) != 0 ||
+        fread(magic, 1, 4, movie->file) != 4 || memcmp(magic, MOVIE_INDEX_MAGIC, 4) != 0 ||
+        fseek(movie->file, offset, SEEK_SET) != 0 ||
+        readValue(movie->file, 1, &value) != 0 || value != 'E' ||
+        readValue(movie->file, 4, &frames) != 0 || readValue(movie->file, 4, &count) != 0) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t frame;
+        if (readValue(movie->file, 4, &frame) != 0 || readValue(movie->file, 8, &value) != 0 ||
+            addKeyframe(movie, frame, value) != 0) {
+            return -1;
+        }
+    }
+    movie->frameCount = frames;
+    return 0;
+}
+
+// Rebuilds the index of a movie that was never closed, up to its last
+// complete record
+static void scanMovie(Movie *movie) {
+    uint64_t tag, value, frame, size;
+
+    movie->keyframeCount = 0;
+    movie->frameCount = 0;
+    fseek(movie->file, MOVIE_HEADER_SIZE, SEEK_SET);
+    for (;;) {
+        long offset = ftell(movie->file);
+        if (readValue(movie->file, 1, &tag) != 0) {
+            break;
+        }
+        if (tag == 'R') {
+            if (readValue(movie->file, 1, &value) != 0 || readValue(movie->file, 2, &value) != 0) {
+                break;
+            }
+            movie->frameCount += value;
+        } else if (tag == 'K') {
+            if (readValue(movie->file, 4, &frame) != 0 || readValue(movie->file, 4, &size) != 0 ||
+                readValue(movie->file, 8, &value) != 0 || fseek(movie->file, size, SEEK_CUR) != 0 ||
+                addKeyframe(movie, frame, offset) != 0) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+    info("Movie was not closed, recovered %u frames", movie->frameCount);
+}
+
+int openMovie(Movie *movie, const char *path, GameBoy *gameBoy) {
+    if (!gameBoy->memory.cartridge) {
+        error("Cannot play a movie without a cartridge");
+        return -1;
+    }
+    if (initMovie(movie, MOVIE_PLAY, gameBoy) != 0) {
+        return -1;
+    }
+    if (!(movie->file = fopen(path, "rb"))) {
+        error("Failed to open movie file: %s", path);
+        freeMovie(movie);
+        return -1;
+    }
+    if (readHeader(movie, gameBoy->memory.cartridge) != 0) {
+        freeMovie(movie);
+        return -1;
+    }
+    if (readIndex(movie) != 0) {
+        scanMovie(movie);
+    }
+    if (movie->keyframeCount == 0) {
+        error("Movie contains no keyframes");
+        freeMovie(movie);
+        return -1;
+    }
+    if (seekMovie(movie, gameBoy, 0) != 0) {
+        freeMovie(movie);
+        return -1;
+    }
+    debug("Playing movie %s: %u frames, %u keyframes", path, movie->frameCount, movie->keyframeCount);
+    return 0;
+}
+
+// Reads the record header of the keyframe at the current position
+static int readKeyframeHeader(Movie *movie, uint32_t *frame, uint32_t *size, uint64_t *hash) {
+    uint64_t tag, value, length;
+    if (readValue(movie->file, 1, &tag) != 0 || tag != 'K' ||
+        readValue(movie->file, 4, &value) != 0 || readValue(movie->file, 4, &length) != 0 ||
+        readValue(movie->file, 8, hash) != 0 || length > STATE_MAX_SIZE) {
+        return -1;
+    }
+    *frame = value;
+    *size = length;
+    return 0;
+}
+
+// Sets the input for the next frame. Returns 1 if a frame is due, 0 at the
+// end of the movie and -1 if the file is unreadable.
+int playMovieFrame(Movie *movie, GameBoy *gameBoy) {
+    uint64_t tag, value, expected = 0;
+    int verify = 0;
+
+    while (movie->runLength == 0) {
+        long offset = ftell(movie->file);
+        if (movie->frame >= movie->frameCount || readValue(movie->file, 1, &tag) != 0 || tag == 'E') {
+            return 0;
+        }
+        if (tag == 'R') {
+            if (readValue(movie->file, 1, &value) != 0) {
+                return 0;
+            }
+            movie->runButtons = value;
+            if (readValue(movie->file, 2, &value) != 0) {
+                return 0;
+            }
+            movie->runLength = value;
+        } else if (tag == 'K') {
+            uint32_t frame, size;
+            fseek(movie->file, offset, SEEK_SET);
+            if (readKeyframeHeader(movie, &frame, &size, &expected) != 0 ||
+                fseek(movie->file, size, SEEK_CUR) != 0) {
+                return 0;
+            }
+            verify = frame == movie->frame;
+        } else {
+            error("Corrupt movie record at offset %ld", offset);
+            return -1;
+        }
+    }
+
+    setGameBoyInput(gameBoy, movie->runButtons);
+    if (verify) {
+        uint32_t size = saveGameBoyState(gameBoy, movie->state);
+        if (hashState(movie->state, size) != expected) {
+            movie->desyncs++;
+            error("Movie playback desynced at frame %u", movie->frame);
+        }
+    }
+    movie->runLength--;
+    movie->frame++;
+    return 1;
+}
+
+// Restores the nearest keyframe at or before `frame` and replays the input
+// from there
+int seekMovie(Movie *movie, GameBoy *gameBoy, uint32_t frame) {
+    uint32_t low = 0, high = movie->keyframeCount;
+    uint32_t keyframeFrame, size;
+    uint64_t hash;
+
+    if (movie->mode != MOVIE_PLAY || frame > movie->frameCount) {
+        error("Cannot seek to frame %u of %u", frame, movie->frameCount);
+        return -1;
+    }
+    while (high - low > 1) {
+        uint32_t middle = (low + high) / 2;
+        if (movie->keyframes[middle].frame <= frame) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    MovieKeyframe *keyframe = &movie->keyframes[low];
+    if (fseek(movie->file, keyframe->offset, SEEK_SET) != 0 ||
+        readKeyframeHeader(movie, &keyframeFrame, &size, &hash) != 0 ||
+        fread(movie->state, 1, size, movie->file) != size) {
+        error("Failed to read movie keyframe for frame %u", keyframe->frame);
+        return -1;
+    }
+    if (hashState(movie->state, size) != hash ||
+        loadGameBoyState(gameBoy, movie->state, size) != 0) {
+        error("Movie keyframe for frame %u is corrupt", keyframe->frame);
+        return -1;
+    }
+    movie->frame = keyframeFrame;
+    movie->runLength = 0;
+
+    while (movie->frame < frame) {
+        if (playMovieFrame(movie, gameBoy) != 1) {
+            return -1;
+        }
+        runGameBoyFrame(gameBoy);
+    }
+    return 0;
+}
+
+// Finishes the file with its keyframe index when recording
+int closeMovie(Movie *movie) {
+    int status = 0;
+    if (movie->mode == MOVIE_RECORD && movie->file) {
+        long offset;
+        status = flushRun(movie);
+        if ((offset = ftell(movie->file)) < 0) {
+            status = -1;
+        }
+        status |= writeValue(movie->file, 'E', 1) | writeValue(movie->file, movie->frame, 4) |
+                  writeValue(movie->file, movie->keyframeCount, 4);
+        for (uint32_t i = 0; i < movie->keyframeCount; i++) {
+            status |= writeValue(movie->file, movie->keyframes[i].frame, 4) |
+                      writeValue(movie->file, movie->keyframes[i].offset, 8);
+        }
+        status |= writeValue(movie->file, offset, 8);
+        if (fwrite(MOVIE_INDEX_MAGIC, 1, 4, movie->file) != 4 || ferror(movie->file) ||
+            fclose(movie->file) != 0) {
+            status = -1;
+        }
+        movie->file = NULL;
+        if (status != 0) {
+            error("Failed to finish movie file");
+        }
+    }
+    freeMovie(movie);
+    return status;
+}
@@ -0,0 +1,49 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "gameboy.h"
+
+#define MOVIE_MAGIC "NBMV"
+#define MOVIE_INDEX_MAGIC "NBIX"
+#define MOVIE_VERSION 1
+#define MOVIE_KEYFRAME_INTERVAL 120  // Frames between embedded states
+#define MOVIE_INDEX_RESERVE 2048     // Keyframes indexed before the index grows, over an hour
+
+typedef enum {
+    MOVIE_RECORD,
+    MOVIE_PLAY
+} MovieMode;
+
+typedef struct {
+    uint32_t frame;   // Movie frame the state was taken before
+    uint64_t offset;  // File offset of its record
+} MovieKeyframe;
+
+// Per-frame joypad input streamed to or from disk as runs of equal input,
+// with a state keyframe every `interval` frames for seeking
+typedef struct {
+    FILE *file;
+    struct Arena *arena;     // The instance's, which holds the buffers below
+    MovieMode mode;
+    uint32_t frame;          // Next movie frame to record or play
+    uint32_t frameCount;     // Frames in the movie (playback)
+    uint16_t interval;
+    uint8_t runButtons;      // Input of the current run
+    uint32_t runLength;      // Frames left (playback) or pending (recording)
+    MovieKeyframe *keyframes;
+    uint32_t keyframeCount;
+    uint32_t keyframeCapacity;
+    uint8_t *state;          // Scratch buffer for one keyframe
+    uint32_t desyncs;        // Keyframes the playback did not reproduce
+} Movie;
+
+int startMovieRecording(Movie *movie, const char *path, GameBoy *gameBoy);
+int recordMovieFrame(Movie *movie, const GameBoy *gameBoy);
+int openMovie(Movie *movie, const char *path, GameBoy *gameBoy);
+int playMovieFrame(Movie *movie, GameBoy *gameBoy);
+int seekMovie(Movie *movie, GameBoy *gameBoy, uint32_t frame);
+int closeMovie(Movie *movie);
+
+#endif
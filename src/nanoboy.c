@@ -0,0 +1,105 @@
+#include "nanoboy.h"
+#include "arena.h"
+#include "gameboy.h"
+#include "video.h"
+#include "utils.h"
+
+_Static_assert(NANOBOY_SCREEN_WIDTH == FRAME_WIDTH && NANOBOY_SCREEN_HEIGHT == FRAME_HEIGHT,
+               "Public screen size out of sync");
+_Static_assert(NANOBOY_CYCLES_PER_FRAME == CYCLES_PER_FRAME, "Public frame length out of sync");
+_Static_assert(NANOBOY_START == JOYPAD_START && NANOBOY_RIGHT == JOYPAD_RIGHT,
+               "Public button bits out of sync");
+
+_Static_assert((int)NANOBOY_PPU_SCANLINE == (int)PPU_SCANLINE &&
+               (int)NANOBOY_PPU_FIFO == (int)PPU_FIFO, "Public PPU engines out of sync");
+
+struct NanoBoy {
+    GameBoy gameBoy;
+};
+
+// The instance lives at the front of its own arena, so creating one is a
+// single allocation and destroying it a single free
+NanoBoy *createNanoBoy(void) {
+    ArenaConfig config = { .objectBytes = sizeof(NanoBoy) };
+    Arena *arena = createArena(&config);
+    if (!arena) {
+        return NULL;
+    }
+    NanoBoy *nanoBoy = allocArenaObject(arena, sizeof(NanoBoy));
+    int result = nanoBoy ? initGameBoy(&nanoBoy->gameBoy, arena) : -1;
+    releaseArena(arena);  // The instance holds its own reference now
+    return result == 0 ? nanoBoy : NULL;
+}
+
+void destroyNanoBoy(NanoBoy *nanoBoy) {
+    if (nanoBoy) {
+        freeGameBoy(&nanoBoy->gameBoy);
+    }
+}
+
+// Copies the image; the caller may free `rom` afterwards
+int loadNanoBoyROM(NanoBoy *nanoBoy, const void *rom, size_t size) {
+    Cartridge *cartridge = loadCartridgeFromMemory(rom, size);
+    if (!cartridge) {
+        return -1;
+    }
+    insertGameBoyCartridge(&nanoBoy->gameBoy, cartridge);
+    releaseCartridge(cartridge);
+    return 0;
+}
+
+// Call before running the first frame
+int setNanoBoyPPU(NanoBoy *nanoBoy, NanoBoyPPU engine) {
+    if ((unsigned)engine >= PPU_ENGINE_COUNT) {
+        error("Unknown PPU engine: %d", (int)engine);
+        return -1;
+    }
+    selectPPUEngine(&nanoBoy->gameBoy.ppu, (PPUEngine)engine);
+    return 0;
+}
+
+void runNanoBoyFrame(NanoBoy *nanoBoy) {
+    runGameBoyFrame(&nanoBoy->gameBoy);
+}
+
+void runNanoBoyUntil(NanoBoy *nanoBoy, uint64_t cycle) {
+    runGameBoyUntil(&nanoBoy->gameBoy, cycle);
+}
+
+void setNanoBoyInput(NanoBoy *nanoBoy, uint8_t buttons) {
+    setGameBoyInput(&nanoBoy->gameBoy, buttons);
+}
+
+uint64_t nanoBoyCycles(const NanoBoy *nanoBoy) {
+    return nanoBoy->gameBoy.cpu.timer.cycleCount;
+}
+
+uint32_t nanoBoyFrames(const NanoBoy *nanoBoy) {
+    return nanoBoy->gameBoy.frames;
+}
+
+// 160x144 shade indices 0-3, one byte per pixel, row by row. Lines are
+// drawn as the PPU reaches them; at frame boundaries the buffer holds the
+// frame that just ended.
+const uint8_t *nanoBoyFramebuffer(const NanoBoy *nanoBoy) {
+    return nanoBoy->gameBoy.ppu.frame->pixels;
+}
+
+// There is no APU yet, so no samples are ever produced
+const int16_t *nanoBoyAudio(const NanoBoy *nanoBoy, size_t *samples) {
+    (void)nanoBoy;
+    *samples = 0;
+    return NULL;
+}
+
+// Memory as the CPU sees it from `address` up to the end of its 4KB page
+// (or of 0xFE00-0xFFFF); the joypad register reads back raw there
+const uint8_t *nanoBoyMemory(const NanoBoy *nanoBoy, uint16_t address, size_t *length) {
+    const Memory *memory = &nanoBoy->gameBoy.memory;
+    if (address >= HIGH_MEMORY_START) {
+        *length = 0x10000 - address;
+        return &memory->high[address - HIGH_MEMORY_START];
+    }
+    *length = MEMORY_PAGE_SIZE - (address & (MEMORY_PAGE_SIZE - 1));
+    return readableMemory(memory, address);
+}
@@ -0,0 +1,51 @@
+#ifndef NANOBOY_H
+#define NANOBOY_H
+
+// Embedding API of libnanoboy. Every call only touches the instance it is
+// given, so separate instances can be driven from separate threads.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NANOBOY_SCREEN_WIDTH 160
+#define NANOBOY_SCREEN_HEIGHT 144
+#define NANOBOY_CYCLES_PER_FRAME 70224
+
+// Buttons for setNanoBoyInput, set bits mean pressed
+#define NANOBOY_RIGHT  0x01
+#define NANOBOY_LEFT   0x02
+#define NANOBOY_UP     0x04
+#define NANOBOY_DOWN   0x08
+#define NANOBOY_A      0x10
+#define NANOBOY_B      0x20
+#define NANOBOY_SELECT 0x40
+#define NANOBOY_START  0x80
+
+// PPU engines; the scanline one is the default and much faster, the FIFO
+// one also shows register writes made in the middle of a line
+typedef enum {
+    NANOBOY_PPU_SCANLINE,
+    NANOBOY_PPU_FIFO
+} NanoBoyPPU;
+
+// The only symbols libnanoboy.so exports; everything else is built hidden
+#define NANOBOY_API __attribute__((visibility("default")))
+
+typedef struct NanoBoy NanoBoy;
+
+NANOBOY_API NanoBoy *createNanoBoy(void);
+NANOBOY_API void destroyNanoBoy(NanoBoy *nanoBoy);
+NANOBOY_API int loadNanoBoyROM(NanoBoy *nanoBoy, const void *rom, size_t size);
+NANOBOY_API int setNanoBoyPPU(NanoBoy *nanoBoy, NanoBoyPPU engine);
+NANOBOY_API void runNanoBoyFrame(NanoBoy *nanoBoy);
+NANOBOY_API void runNanoBoyUntil(NanoBoy *nanoBoy, uint64_t cycle);
+NANOBOY_API void setNanoBoyInput(NanoBoy *nanoBoy, uint8_t buttons);
+NANOBOY_API uint64_t nanoBoyCycles(const NanoBoy *nanoBoy);
+NANOBOY_API uint32_t nanoBoyFrames(const NanoBoy *nanoBoy);
+
+// Zero-copy views into the instance, valid until its next run call
+NANOBOY_API const uint8_t *nanoBoyFramebuffer(const NanoBoy *nanoBoy);
+NANOBOY_API const int16_t *nanoBoyAudio(const NanoBoy *nanoBoy, size_t *samples);
+NANOBOY_API const uint8_t *nanoBoyMemory(const NanoBoy *nanoBoy, uint16_t address, size_t *length);
+
+#endif
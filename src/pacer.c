@@ -0,0 +1,114 @@
+#include "pacer.h"
+#include "config.h"
+#include "hosttime.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MIN_SPIN_MARGIN 100000ull   // 0.1 ms
+#define MAX_SPIN_MARGIN 2000000ull  // 2 ms
+#define MAX_SYNC_WAIT 250000000ull  // 0.25 s, so a stalled queue cannot hang a frame
+
+void initPacer(Pacer *pacer, PaceMode mode, double speed) {
+    pacer->mode = mode;
+    pacer->deadline = 0;
+    pacer->lastFrame = 0;
+    pacer->spinMargin = 2 * MIN_SPIN_MARGIN;
+    pacer->audioQueued = NULL;
+    pacer->audioContext = NULL;
+    pacer->audioTarget = 0;
+    pacer->frames = 0;
+    memset(pacer->frameTimes, 0, sizeof(pacer->frameTimes));
+    memset(pacer->lateness, 0, sizeof(pacer->lateness));
+    setPacerSpeed(pacer, speed);
+    debug("Pacer Initialized: %.2fx", pacer->speed);
+}
+
+void setPacerSpeed(Pacer *pacer, double speed) {
+    pacer->speed = speed > 0 ? speed : 1.0;
+    pacer->framePeriod = (uint64_t)(FRAME_NANOS / pacer->speed);
+}
+
+void setPacerAudioSync(Pacer *pacer, AudioQueued audioQueued, void *context, uint64_t target) {
+    pacer->mode = PACE_AUDIO;
+    pacer->audioQueued = audioQueued;
+    pacer->audioContext = context;
+    pacer->audioTarget = target;
+}
+
+static void record(uint32_t *histogram, uint64_t nanos, uint64_t bucketNanos) {
+    uint64_t bucket = nanos / bucketNanos;
+    histogram[bucket < PACER_BUCKETS ? bucket : PACER_BUCKETS - 1]++;
+}
+
+// Sleeps for the bulk of the wait and spins through the last stretch, which
+// is sized from how late the kernel has actually been waking us up
+static uint64_t waitUntil(Pacer *pacer, uint64_t deadline) {
+    uint64_t now = hostTimeNanos();
+    if (deadline > now + pacer->spinMargin) {
+        uint64_t wake = deadline - pacer->spinMargin;
+        hostSleepUntilNanos(wake);
+        now = hostTimeNanos();
+        uint64_t overshoot = now > wake ? now - wake : 0;
+        uint64_t margin = (pacer->spinMargin * 7 + overshoot * 2 + MIN_SPIN_MARGIN) / 8;
+        pacer->spinMargin = margin < MIN_SPIN_MARGIN ? MIN_SPIN_MARGIN
+                          : margin > MAX_SPIN_MARGIN ? MAX_SPIN_MARGIN : margin;
+    }
+    while (now < deadline) {
+        hostSpinPause();
+        now = hostTimeNanos();
+    }
+    return now;
+}
+
+// Call once per emulated frame; returns when the frame may be presented
+void waitForNextFrame(Pacer *pacer) {
+    uint64_t now = hostTimeNanos();
+
+    if (pacer->mode == PACE_AUDIO && pacer->audioQueued) {
+        // Queues that drain in steps (whole frames) may need more than one wait
+        uint64_t giveUp = now + MAX_SYNC_WAIT;
+        uint64_t queued;
+        while (now < giveUp &&
+               (queued = pacer->audioQueued(pacer->audioContext)) > pacer->audioTarget) {
+            now = waitUntil(pacer, now + queued - pacer->audioTarget);
+        }
+    } else if (pacer->mode == PACE_REALTIME) {
+        if (pacer->deadline == 0 || now > pacer->deadline + pacer->framePeriod) {
+            // First frame or too far behind to catch up: restart the schedule
+            pacer->deadline = now;
+        } else {
+            now = waitUntil(pacer, pacer->deadline);
+            record(pacer->lateness, now - pacer->deadline, LATENESS_BUCKET_NANOS);
+        }
+        pacer->deadline += pacer->framePeriod;
+    }
+
+    if (pacer->frames > 0) {
+        record(pacer->frameTimes, now - pacer->lastFrame, FRAME_TIME_BUCKET_NANOS);
+    }
+    pacer->lastFrame = now;
+    pacer->frames++;
+}
+
+// Writes both histograms as "name,bucket_ms,count" lines, skipping empty buckets
+int dumpPacerHistograms(const Pacer *pacer, const char *filePath) {
+    FILE *file = fopen(filePath, "w");
+    if (!file) {
+        error("Failed to open histogram file: %s", filePath);
+        return -1;
+    }
+    fprintf(file, "histogram,bucket_ms,count\n");
+    for (int i = 0; i < PACER_BUCKETS; i++) {
+        if (pacer->frameTimes[i]) {
+            fprintf(file, "frame_time,%.2f,%u\n", i * FRAME_TIME_BUCKET_NANOS / 1e6, pacer->frameTimes[i]);
+        }
+    }
+    for (int i = 0; i < PACER_BUCKETS; i++) {
+        if (pacer->lateness[i]) {
+            fprintf(file, "lateness,%.2f,%u\n", i * LATENESS_BUCKET_NANOS / 1e6, pacer->lateness[i]);
+        }
+    }
+    fclose(file);
+    return 0;
+}
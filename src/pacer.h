@@ -0,0 +1,40 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+
+#define PACER_BUCKETS 500            // Histogram buckets, the last one collects overflow
+#define FRAME_TIME_BUCKET_NANOS 100000  // 0.1 ms per frame-time bucket
+#define LATENESS_BUCKET_NANOS 10000     // 0.01 ms per wake-up lateness bucket
+
+typedef enum {
+    PACE_REALTIME,  // Frame deadlines from the host clock
+    PACE_TURBO,     // No waiting at all
+    PACE_AUDIO      // Wait while a host output queue (audio, frame stream) is full enough
+} PaceMode;
+
+// Nanoseconds of output the host still has queued for playback
+typedef uint64_t (*AudioQueued)(void *context);
+
+typedef struct {
+    PaceMode mode;
+    double speed;              // Emulated speed multiplier
+    uint64_t framePeriod;      // Host nanoseconds per emulated frame at speed
+    uint64_t deadline;         // When the next frame is due
+    uint64_t lastFrame;        // When the previous frame was released
+    uint64_t spinMargin;       // Final stretch spent spinning instead of sleeping
+    AudioQueued audioQueued;
+    void *audioContext;
+    uint64_t audioTarget;      // Queue length to keep in audio sync mode
+    uint64_t frames;
+    uint32_t frameTimes[PACER_BUCKETS];  // Host time between released frames
+    uint32_t lateness[PACER_BUCKETS];    // Wake-up time past the deadline
+} Pacer;
+
+void initPacer(Pacer *pacer, PaceMode mode, double speed);
+void setPacerSpeed(Pacer *pacer, double speed);
+void setPacerAudioSync(Pacer *pacer, AudioQueued audioQueued, void *context, uint64_t target);
+void waitForNextFrame(Pacer *pacer);
+int dumpPacerHistograms(const Pacer *pacer, const char *filePath);
+
+#endif
@@ -0,0 +1,95 @@
+#include "ppu.h"
+#include <string.h>
+
+// Steps a background fetcher and pixel FIFO once per dot, reading the
+// registers as they are at that dot. The first fetch of a line is done
+// twice (6 dots thrown away), each fetch takes 6 dots and is pushed as
+// soon as the FIFO runs empty, and one pixel is shifted out per dot. That
+// fills mode 3 exactly: 12 + SCX % 8 + 160 dots.
+
+#define FETCH_DOTS 6
+#define MAX_EXTRA_DOTS 64  // Bound on dots run after mode 3 ends
+
+static void startTransfer(PPU *ppu, const Memory *memory) {
+    PixelFIFO *fifo = &ppu->fifo;
+    memset(fifo, 0, sizeof(PixelFIFO));
+    fifo->warmup = FETCH_DOTS;
+    fifo->discard = memory->high[SCROLL_X - HIGH_MEMORY_START] & 7;
+}
+
+static void fetch(PPU *ppu, const Memory *memory) {
+    PixelFIFO *fifo = &ppu->fifo;
+    uint8_t control = memory->high[LCD_CONTROL - HIGH_MEMORY_START];
+    uint8_t row = memory->high[SCROLL_Y - HIGH_MEMORY_START] + ppu->line;
+
+    if (fifo->step < FETCH_DOTS) {
+        // Tile number, low plane and high plane, two dots each
+        switch (++fifo->step) {
+            case 2: {
+                uint8_t column = (memory->high[SCROLL_X - HIGH_MEMORY_START] & 0xF8) + fifo->column * 8;
+                fifo->tile = backgroundTile(memory, control, row, column);
+                break;
+            }
+            case 4:
+                fifo->low = vram(memory, tileRowAddress(control, fifo->tile, row));
+                break;
+            case 6:
+                fifo->high = vram(memory, tileRowAddress(control, fifo->tile, row) + 1);
+                break;
+        }
+    } else if (fifo->count == 0) {
+        for (int bit = 7; bit >= 0; bit--) {
+            fifo->colors[(fifo->head + 7 - bit) & 15] =
+                ((fifo->high >> bit) & 1) << 1 | ((fifo->low >> bit) & 1);
+        }
+        fifo->count = 8;
+        fifo->column++;
+        fifo->step = 0;
+    }
+}
+
+static void shiftOut(PPU *ppu, const Memory *memory) {
+    PixelFIFO *fifo = &ppu->fifo;
+    if (fifo->count == 0 || fifo->x >= FRAME_WIDTH) {
+        return;
+    }
+    uint8_t color = fifo->colors[fifo->head];
+    fifo->head = (fifo->head + 1) & 15;
+    fifo->count--;
+    if (fifo->discard) {
+        fifo->discard--;
+        return;
+    }
+
+    uint8_t control = memory->high[LCD_CONTROL - HIGH_MEMORY_START];
+    uint8_t palette = memory->high[BG_PALETTE - HIGH_MEMORY_START];
+    ppu->frame->pixels[ppu->line * FRAME_WIDTH + fifo->x++] =
+        control & LCDC_BG_ENABLE ? (palette >> (color * 2)) & 3 : 0;
+}
+
+static void advance(PPU *ppu, const Memory *memory, uint32_t dots) {
+    PixelFIFO *fifo = &ppu->fifo;
+    for (uint32_t i = 0; i < dots && fifo->x < FRAME_WIDTH; i++) {
+        if (fifo->warmup) {
+            fifo->warmup--;
+            continue;
+        }
+        fetch(ppu, memory);
+        shiftOut(ppu, memory);
+    }
+}
+
+// The FIFO is timed to drain exactly as mode 3 ends; this only guarantees
+// a line is never left half drawn
+static void finishTransfer(PPU *ppu, const Memory *memory) {
+    for (int i = 0; i < MAX_EXTRA_DOTS && ppu->fifo.x < FRAME_WIDTH; i++) {
+        advance(ppu, memory, 1);
+    }
+}
+
+const PPUEngineOps pixelFifoEngine = {
+    .name = "fifo",
+    .startTransfer = startTransfer,
+    .advance = advance,
+    .finishTransfer = finishTransfer,
+};
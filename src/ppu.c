@@ -0,0 +1,240 @@
+#include "ppu.h"
+#include "arena.h"
+#include "utils.h"
+#include <string.h>
+
+// Mode timing is shared by both engines: every line is 80 cycles of OAM
+// scan, then mode 3 for 172 cycles plus SCX fine scroll, then hblank.
+// Lines 144-153 are vblank. The PPU does not run alongside the CPU; it
+// catches up to the CPU's cycle count whenever its registers or IF are
+// accessed and at the end of every run.
+
+static const PPUEngineOps *engines[PPU_ENGINE_COUNT] = {
+    [PPU_SCANLINE] = &scanlineEngine,
+    [PPU_FIFO] = &pixelFifoEngine,
+};
+
+// Mirrors LY, the STAT mode and the LY=LYC flag into the register file
+static void updateRegisters(PPU *ppu, Memory *memory) {
+    uint8_t *status = &memory->high[LCD_STATUS - HIGH_MEMORY_START];
+    uint8_t coincidence = ppu->line == memory->high[LCD_LINE_COMPARE - HIGH_MEMORY_START] ? 0x04 : 0;
+    memory->high[LCD_LINE - HIGH_MEMORY_START] = ppu->line;
+    *status = (*status & 0x78) | 0x80 | coincidence | ppu->mode;
+}
+
+// Starts the display at line 0, as when the LCD is switched on
+static void startDisplay(PPU *ppu, Memory *memory, uint64_t cycle) {
+    ppu->position = cycle;
+    ppu->lineStart = cycle;
+    ppu->line = 0;
+    ppu->mode = PPU_OAM_SCAN;
+    updateRegisters(ppu, memory);
+}
+
+static void releaseFrame(Memory *memory, FrameBuffer *frame) {
+    if (frame && atomic_fetch_sub(&frame->refs, 1) == 1) {
+        freeArenaObject(memory->arena, frame, sizeof(FrameBuffer));
+    }
+}
+
+// Gives the PPU a picture of its own before it draws into it. Returns 0 if
+// it is headless or no copy could be made, in which case nothing is drawn.
+static int ownFrame(PPU *ppu, Memory *memory) {
+    if (!ppu->frame) {
+        return 0;
+    }
+    if (atomic_load_explicit(&ppu->frame->refs, memory_order_acquire) == 1) {
+        return 1;
+    }
+    FrameBuffer *copy = allocArenaObject(memory->arena, sizeof(FrameBuffer));
+    if (!copy) {
+        return 0;
+    }
+    atomic_init(&copy->refs, 1);
+    memcpy(copy->pixels, ppu->frame->pixels, FRAME_PIXELS);
+    releaseFrame(memory, ppu->frame);
+    ppu->frame = copy;
+    return 1;
+}
+
+// Post-boot state: LCD and background on with the usual palette
+int initPPU(PPU *ppu, Memory *memory, const uint64_t *clock) {
+    if (!(ppu->frame = allocArenaObject(memory->arena, sizeof(FrameBuffer)))) {
+        return -1;
+    }
+    atomic_init(&ppu->frame->refs, 1);
+    memset(ppu->frame->pixels, 0, FRAME_PIXELS);
+    ppu->clock = clock;
+    ppu->transferCycles = TRANSFER_CYCLES;
+    memset(&ppu->fifo, 0, sizeof(ppu->fifo));
+    selectPPUEngine(ppu, PPU_SCANLINE);
+    memory->high[LCD_CONTROL - HIGH_MEMORY_START] = LCDC_ENABLE | LCDC_TILE_DATA | LCDC_BG_ENABLE;
+    memory->high[BG_PALETTE - HIGH_MEMORY_START] = 0xFC;
+    memory->ppu = ppu;
+    ppu->restartCycle = *clock;
+    ppu->restarted = 0;
+    startDisplay(ppu, memory, *clock);
+    return 0;
+}
+
+void freePPU(PPU *ppu, Memory *memory) {
+    releaseFrame(memory, ppu->frame);
+    ppu->frame = NULL;
+}
+
+// Keeps the timing and registers going but draws nothing from now on
+void detachPPUFrame(PPU *ppu, Memory *memory) {
+    freePPU(ppu, memory);
+}
+
+void forkPPU(PPU *child, const PPU *parent, Memory *memory, const uint64_t *clock) {
+    *child = *parent;
+    if (child->frame) {
+        atomic_fetch_add(&child->frame->refs, 1);
+    }
+    child->clock = clock;
+    memory->ppu = child;
+}
+
+// Takes over a fork taken earlier, along with its reference to the picture
+void restorePPU(PPU *ppu, PPU *snapshot, Memory *memory, const uint64_t *clock) {
+    releaseFrame(memory, ppu->frame);
+    *ppu = *snapshot;
+    ppu->clock = clock;
+    memory->ppu = ppu;
+}
+
+// Engines can be switched at any line boundary, but are meant to be picked
+// once at startup
+void selectPPUEngine(PPU *ppu, PPUEngine engine) {
+    ppu->engine = engine;
+    ppu->ops = engines[engine];
+}
+
+int parsePPUEngine(const char *name, PPUEngine *engine) {
+    for (int i = 0; i < PPU_ENGINE_COUNT; i++) {
+        if (strcmp(name, engines[i]->name) == 0) {
+            *engine = i;
+            return 0;
+        }
+    }
+    error("Unknown PPU engine: %s (scanline or fifo)", name);
+    return -1;
+}
+
+static void enterMode(PPU *ppu, Memory *memory, PPUMode mode) {
+    ppu->mode = mode;
+    updateRegisters(ppu, memory);
+}
+
+static void nextLine(PPU *ppu, Memory *memory) {
+    ppu->lineStart += LINE_CYCLES;
+    ppu->line++;
+    if (ppu->line == FRAME_HEIGHT) {
+        memory->high[INTERRUPT_FLAG - HIGH_MEMORY_START] |= INTERRUPT_VBLANK;
+        enterMode(ppu, memory, PPU_VBLANK);
+    } else if (ppu->line == LINES_PER_FRAME) {
+        ppu->line = 0;
+        enterMode(ppu, memory, PPU_OAM_SCAN);
+    } else {
+        enterMode(ppu, memory, ppu->line < FRAME_HEIGHT ? PPU_OAM_SCAN : PPU_VBLANK);
+    }
+}
+
+// Processes every mode change up to the CPU's current cycle
+void runPPU(PPU *ppu, Memory *memory) {
+    uint64_t now = *ppu->clock;
+    if (!(memory->high[LCD_CONTROL - HIGH_MEMORY_START] & LCDC_ENABLE)) {
+        ppu->position = now;
+        return;
+    }
+
+    while (ppu->position < now) {
+        uint64_t transferStart = ppu->lineStart + OAM_SCAN_CYCLES;
+        uint64_t event;
+        switch (ppu->mode) {
+            case PPU_OAM_SCAN:
+                event = transferStart;
+                break;
+            case PPU_TRANSFER:
+                event = transferStart + ppu->transferCycles;
+                if (ppu->ops->advance && ownFrame(ppu, memory)) {
+                    uint64_t until = event < now ? event : now;
+                    ppu->ops->advance(ppu, memory, until - ppu->position);
+                }
+                break;
+            default:
+                event = ppu->lineStart + LINE_CYCLES;
+                break;
+        }
+        if (event > now) {
+            ppu->position = now;
+            break;
+        }
+
+        ppu->position = event;
+        switch (ppu->mode) {
+            case PPU_OAM_SCAN:
+                ppu->transferCycles = TRANSFER_CYCLES +
+                    (memory->high[SCROLL_X - HIGH_MEMORY_START] & 7);
+                enterMode(ppu, memory, PPU_TRANSFER);
+                if (ownFrame(ppu, memory)) {
+                    ppu->ops->startTransfer(ppu, memory);
+                }
+                break;
+            case PPU_TRANSFER:
+                if (ownFrame(ppu, memory)) {
+                    ppu->ops->finishTransfer(ppu, memory);
+                }
+                enterMode(ppu, memory, PPU_HBLANK);
+                break;
+            default:
+                nextLine(ppu, memory);
+                break;
+        }
+    }
+}
+
+// Called for CPU writes to IF and 0xFF40-0xFF4B; the PPU first catches up
+// so the write lands at the right dot
+void writePPURegister(PPU *ppu, Memory *memory, uint16_t address, uint8_t value) {
+    uint8_t *reg = &memory->high[address - HIGH_MEMORY_START];
+    runPPU(ppu, memory);
+
+    switch (address) {
+        case LCD_CONTROL: {
+            uint8_t previous = *reg;
+            *reg = value;
+            if (!((previous ^ value) & LCDC_ENABLE)) {
+                break;
+            }
+            if (value & LCDC_ENABLE) {
+                // Frames restart with line 0, see realignGameBoyFrame
+                startDisplay(ppu, memory, *ppu->clock);
+                ppu->restartCycle = *ppu->clock;
+                ppu->restarted = 1;
+            } else {
+                // Switched off: LY stays 0 and the screen goes blank
+                ppu->line = 0;
+                ppu->mode = PPU_HBLANK;
+                updateRegisters(ppu, memory);
+                if (ownFrame(ppu, memory)) {
+                    memset(ppu->frame->pixels, 0, FRAME_PIXELS);
+                }
+            }
+            break;
+        }
+        case LCD_STATUS:
+            *reg = (*reg & 0x07) | (value & 0x78) | 0x80;
+            break;
+        case LCD_LINE:
+            break;  // Read only
+        case LCD_LINE_COMPARE:
+            *reg = value;
+            updateRegisters(ppu, memory);
+            break;
+        default:
+            *reg = value;
+            break;
+    }
+}
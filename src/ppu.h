@@ -0,0 +1,94 @@
+#ifndef PPU_H
+#define PPU_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "memory.h"
+#include "video.h"
+
+#define LCD_STATUS 0xFF41
+#define LCD_LINE 0xFF44
+#define LCD_LINE_COMPARE 0xFF45
+#define PPU_FIRST_REGISTER LCD_CONTROL
+#define PPU_LAST_REGISTER 0xFF4B
+#define INTERRUPT_VBLANK 0x01
+
+#define LINE_CYCLES 456
+#define LINES_PER_FRAME 154
+#define OAM_SCAN_CYCLES 80
+#define TRANSFER_CYCLES 172  // Shortest mode 3, lengthened by SCX fine scroll
+
+// STAT mode numbers
+typedef enum {
+    PPU_HBLANK = 0,
+    PPU_VBLANK = 1,
+    PPU_OAM_SCAN = 2,
+    PPU_TRANSFER = 3
+} PPUMode;
+
+typedef enum {
+    PPU_SCANLINE,  // Whole line drawn from the registers at mode 3 start
+    PPU_FIFO,      // Pixel FIFO stepped per dot, sees mid-line register writes
+    PPU_ENGINE_COUNT
+} PPUEngine;
+
+// Background fetcher and pixel FIFO state, only used by the FIFO engine
+typedef struct {
+    uint8_t colors[16];  // Ring of color numbers waiting to be shifted out
+    uint8_t head;
+    uint8_t count;
+    uint8_t warmup;      // Dots left of the discarded first fetch
+    uint8_t step;        // Dots into the current tile fetch, 6 once ready to push
+    uint8_t column;      // Tiles fetched so far on this line
+    uint8_t tile;
+    uint8_t low, high;   // Bitplanes of the fetched tile row
+    uint8_t discard;     // Pixels still dropped for SCX fine scroll
+    uint8_t x;           // Pixels output so far
+} PixelFIFO;
+
+// Shared copy-on-write between forks like memory pages. The PPU takes its
+// own copy before it draws, so a fork that never reaches mode 3 costs nothing.
+typedef struct {
+    atomic_uint refs;                // Instances showing this picture
+    uint8_t pixels[FRAME_PIXELS];
+} FrameBuffer;
+
+struct PPU;
+
+// The shared timing code calls into an engine at the same events for both
+typedef struct {
+    const char *name;
+    void (*startTransfer)(struct PPU *ppu, const Memory *memory);       // Mode 3 begins
+    void (*advance)(struct PPU *ppu, const Memory *memory, uint32_t dots);  // Within mode 3
+    void (*finishTransfer)(struct PPU *ppu, const Memory *memory);      // Mode 0 begins
+} PPUEngineOps;
+
+typedef struct PPU {
+    const PPUEngineOps *ops;
+    PPUEngine engine;
+    const uint64_t *clock;     // Cycle counter of the owning CPU
+    uint64_t position;         // Cycle the PPU has caught up to
+    uint64_t lineStart;        // Cycle the current line began
+    uint16_t transferCycles;   // Length of mode 3 on the current line
+    uint64_t restartCycle;     // Cycle the LCD was last switched back on
+    uint8_t restarted;         // Set until the frame loop has realigned to it
+    uint8_t line;              // LY
+    uint8_t mode;              // PPUMode
+    PixelFIFO fifo;
+    FrameBuffer *frame;        // Complete from vblank until the next mode 3, NULL if headless
+} PPU;
+
+extern const PPUEngineOps scanlineEngine;
+extern const PPUEngineOps pixelFifoEngine;
+
+int initPPU(PPU *ppu, Memory *memory, const uint64_t *clock);
+void freePPU(PPU *ppu, Memory *memory);
+void detachPPUFrame(PPU *ppu, Memory *memory);
+void forkPPU(PPU *child, const PPU *parent, Memory *memory, const uint64_t *clock);
+void restorePPU(PPU *ppu, PPU *snapshot, Memory *memory, const uint64_t *clock);
+void selectPPUEngine(PPU *ppu, PPUEngine engine);
+int parsePPUEngine(const char *name, PPUEngine *engine);
+void runPPU(PPU *ppu, Memory *memory);
+void writePPURegister(PPU *ppu, Memory *memory, uint16_t address, uint8_t value);
+
+#endif
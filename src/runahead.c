@@ -0,0 +1,69 @@
+#include "runahead.h"
+#include "hosttime.h"
+#include "utils.h"
+
+void initRunAhead(RunAhead *runAhead, RunAheadMode mode, int frames) {
+    runAhead->mode = mode;
+    runAhead->frames = frames > 0 ? frames : 0;
+    runAhead->hasShadow = 0;
+    runAhead->hostFrames = 0;
+    runAhead->frameNanos = 0;
+    runAhead->extraNanos = 0;
+    debug("Run-ahead Initialized: %d frames", runAhead->frames);
+}
+
+void freeRunAhead(RunAhead *runAhead) {
+    if (runAhead->hasShadow) {
+        freeGameBoy(&runAhead->shadow);
+        runAhead->hasShadow = 0;
+    }
+}
+
+static void runFramesAhead(GameBoy *gameBoy, int frames) {
+    for (int i = 0; i < frames; i++) {
+        runGameBoyFrame(gameBoy);
+    }
+}
+
+// Advances the real state by one frame with the given input and presents the
+// state `frames` frames later, assuming the input stays held until then
+void runAheadFrame(RunAhead *runAhead, GameBoy *gameBoy, uint8_t buttons,
+                   PresentFrame present, void *context) {
+    uint64_t start = hostTimeNanos();
+
+    setGameBoyInput(gameBoy, buttons);
+    runGameBoyFrame(gameBoy);
+    uint64_t framed = hostTimeNanos();
+
+    if (runAhead->frames == 0) {
+        if (present) present(gameBoy, context);
+    } else if (runAhead->mode == RUNAHEAD_SINGLE) {
+        // Snapshot and restore are page-table forks, so running ahead only
+        // pays for copying the pages it actually writes. The snapshot holds
+        // the save file meanwhile, so speculative frames never reach it.
+        forkGameBoy(&runAhead->shadow, gameBoy);
+        moveGameBoyBattery(&runAhead->shadow, gameBoy);
+        runFramesAhead(gameBoy, runAhead->frames);
+        if (present) present(gameBoy, context);
+        restoreGameBoy(gameBoy, &runAhead->shadow);
+    } else {
+        freeRunAhead(runAhead);
+        forkGameBoy(&runAhead->shadow, gameBoy);
+        runAhead->hasShadow = 1;
+        runFramesAhead(&runAhead->shadow, runAhead->frames);
+        if (present) present(&runAhead->shadow, context);
+    }
+
+    uint64_t end = hostTimeNanos();
+    runAhead->hostFrames++;
+    runAhead->frameNanos += framed - start;
+    runAhead->extraNanos += end - framed;
+}
+
+// Average host time run-ahead adds to each host frame
+uint64_t runAheadCostNanos(const RunAhead *runAhead) {
+    if (runAhead->hostFrames == 0) {
+        return 0;
+    }
+    return runAhead->extraNanos / runAhead->hostFrames;
+}
@@ -0,0 +1,30 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <stdint.h>
+#include "gameboy.h"
+
+typedef enum {
+    RUNAHEAD_SINGLE,           // Snapshot, run ahead, restore
+    RUNAHEAD_SECOND_INSTANCE   // Keep the ahead fork until the next frame
+} RunAheadMode;
+
+typedef void (*PresentFrame)(const GameBoy *gameBoy, void *context);
+
+typedef struct {
+    RunAheadMode mode;
+    int frames;             // Frames emulated ahead of the real state
+    GameBoy shadow;         // Snapshot (single) or ahead instance (second)
+    int hasShadow;          // Whether shadow holds memory pages to release
+    uint64_t hostFrames;    // Host frames run so far
+    uint64_t frameNanos;    // Host time spent on the real frames
+    uint64_t extraNanos;    // Host time added by running ahead
+} RunAhead;
+
+void initRunAhead(RunAhead *runAhead, RunAheadMode mode, int frames);
+void freeRunAhead(RunAhead *runAhead);
+void runAheadFrame(RunAhead *runAhead, GameBoy *gameBoy, uint8_t buttons,
+                   PresentFrame present, void *context);
+uint64_t runAheadCostNanos(const RunAhead *runAhead);
+
+#endif
@@ -0,0 +1,21 @@
+#include "ppu.h"
+
+// Draws each line in one go when mode 3 begins. The registers are sampled
+// once for the whole line, so writes during mode 3 only show on the next.
+
+static void startTransfer(PPU *ppu, const Memory *memory) {
+    LineRegisters registers;
+    readLineRegisters(memory, &registers);
+    renderLine(memory, &registers, ppu->line, &ppu->frame->pixels[ppu->line * FRAME_WIDTH]);
+}
+
+static void finishTransfer(PPU *ppu, const Memory *memory) {
+    (void)ppu; (void)memory;
+}
+
+const PPUEngineOps scanlineEngine = {
+    .name = "scanline",
+    .startTransfer = startTransfer,
+    .advance = NULL,
+    .finishTransfer = finishTransfer,
+};
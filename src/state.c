@@ -0,0 +1,236 @@
+#include "state.h"
+#include "idiom.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t offset;
+} StateReader;
+
+static uint8_t *put(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        *out++ = (uint8_t)(value >> (i * 8));
+    }
+    return out;
+}
+
+// Reads past the end yield 0; callers check `offset` once at the end
+static uint64_t get(StateReader *reader, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        if (reader->offset < reader->size) {
+            value |= (uint64_t)reader->data[reader->offset] << (i * 8);
+        }
+        reader->offset++;
+    }
+    return value;
+}
+
+// The FIFO engine's mid-line state is only kept during mode 3, so states
+// taken elsewhere are the same whichever engine is running
+static uint8_t *putPPU(uint8_t *out, const PPU *ppu) {
+    static const PixelFIFO idle;
+    const PixelFIFO *fifo = ppu->mode == PPU_TRANSFER ? &ppu->fifo : &idle;
+    out = put(out, ppu->position, 8);
+    out = put(out, ppu->lineStart, 8);
+    out = put(out, ppu->transferCycles, 2);
+    out = put(out, ppu->line, 1);
+    out = put(out, ppu->mode, 1);
+    memcpy(out, fifo->colors, sizeof(fifo->colors));
+    out += sizeof(fifo->colors);
+    out = put(out, fifo->head, 1);
+    out = put(out, fifo->count, 1);
+    out = put(out, fifo->warmup, 1);
+    out = put(out, fifo->step, 1);
+    out = put(out, fifo->column, 1);
+    out = put(out, fifo->tile, 1);
+    out = put(out, fifo->low, 1);
+    out = put(out, fifo->high, 1);
+    out = put(out, fifo->discard, 1);
+    out = put(out, fifo->x, 1);
+    return out;
+}
+
+static uint8_t *putTimer(uint8_t *out, const Timer *timer) {
+    out = put(out, timer->cycleCount, 8);
+    out = put(out, timer->dividerStart, 8);
+    out = put(out, timer->counterStart, 8);
+    out = put(out, timer->counter, 1);
+    out = put(out, timer->modulo, 1);
+    out = put(out, timer->control, 1);
+    return out;
+}
+
+// The overflow cycle is derived, so it is rescheduled rather than stored
+static void getTimer(StateReader *reader, Timer *timer) {
+    timer->cycleCount = get(reader, 8);
+    timer->dividerStart = get(reader, 8);
+    timer->counterStart = get(reader, 8);
+    timer->counter = get(reader, 1);
+    timer->modulo = get(reader, 1);
+    timer->control = get(reader, 1) | 0xF8;
+    scheduleTimer(timer);
+}
+
+static void getPPU(StateReader *reader, PPU *ppu) {
+    PixelFIFO *fifo = &ppu->fifo;
+    ppu->position = get(reader, 8);
+    ppu->lineStart = get(reader, 8);
+    ppu->transferCycles = get(reader, 2);
+    ppu->restarted = 0;  // Only pending within a run call
+    ppu->line = get(reader, 1) % LINES_PER_FRAME;
+    ppu->mode = ppu->line < FRAME_HEIGHT ? get(reader, 1) & 3 : (get(reader, 1), PPU_VBLANK);
+    for (size_t i = 0; i < sizeof(fifo->colors); i++) {
+        fifo->colors[i] = get(reader, 1) & 3;
+    }
+    fifo->head = get(reader, 1) & 15;
+    fifo->count = get(reader, 1);
+    fifo->warmup = get(reader, 1);
+    fifo->step = get(reader, 1);
+    fifo->column = get(reader, 1);
+    fifo->tile = get(reader, 1);
+    fifo->low = get(reader, 1);
+    fifo->high = get(reader, 1);
+    fifo->discard = get(reader, 1);
+    fifo->x = get(reader, 1);
+}
+
+// Writes at most STATE_MAX_SIZE bytes and returns the size used
+uint32_t saveGameBoyState(const GameBoy *gameBoy, uint8_t *buffer) {
+    const CPU *cpu = &gameBoy->cpu;
+    const Memory *memory = &gameBoy->memory;
+    uint8_t *out = buffer;
+
+    out = put(out, STATE_MAGIC, 4);
+    out = put(out, STATE_VERSION, 2);
+    out = put(out, cpu->a, 1);
+    out = put(out, cpu->f, 1);
+    out = put(out, cpu->b, 1);
+    out = put(out, cpu->c, 1);
+    out = put(out, cpu->d, 1);
+    out = put(out, cpu->e, 1);
+    out = put(out, cpu->h, 1);
+    out = put(out, cpu->l, 1);
+    out = put(out, cpu->sp, 2);
+    out = put(out, cpu->pc, 2);
+    out = put(out, cpu->ime, 1);
+    out = put(out, cpu->halted, 1);
+    out = putTimer(out, &cpu->timer);
+    out = put(out, gameBoy->frameStart, 8);
+    out = put(out, gameBoy->frames, 4);
+    out = put(out, gameBoy->running != 0, 1);
+    out = putPPU(out, &gameBoy->ppu);
+
+    out = put(out, memory->romBank, 2);
+    out = put(out, memory->lowBank, 2);
+    out = put(out, memory->ramBank, 1);
+    out = put(out, memory->bankHigh, 1);
+    out = put(out, memory->bankMode, 1);
+    out = put(out, memory->ramEnabled, 1);
+    out = put(out, memory->joypad, 1);
+    out = put(out, memory->serialRequest, 1);
+    memcpy(out, memory->high, HIGH_MEMORY_SIZE);
+    out += HIGH_MEMORY_SIZE;
+
+    // Pages never written stay out of the state entirely
+    uint32_t present = 0;
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        if (memoryPageData(memory, i)) {
+            present |= 1u << i;
+        }
+    }
+    out = put(out, present, 4);
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        const uint8_t *data = memoryPageData(memory, i);
+        if (data) {
+            memcpy(out, data, MEMORY_PAGE_SIZE);
+            out += MEMORY_PAGE_SIZE;
+        }
+    }
+    return (uint32_t)(out - buffer);
+}
+
+int loadGameBoyState(GameBoy *gameBoy, const uint8_t *buffer, uint32_t size) {
+    StateReader reader = { buffer, size, 0 };
+    CPU *cpu = &gameBoy->cpu;
+    Memory *memory = &gameBoy->memory;
+
+    if (get(&reader, 4) != STATE_MAGIC || get(&reader, 2) != STATE_VERSION) {
+        error("Unsupported save state");
+        return -1;
+    }
+    if (!memory->cartridge) {
+        error("Save state needs a cartridge inserted");
+        return -1;
+    }
+
+    cpu->a = get(&reader, 1);
+    cpu->f = get(&reader, 1);
+    cpu->b = get(&reader, 1);
+    cpu->c = get(&reader, 1);
+    cpu->d = get(&reader, 1);
+    cpu->e = get(&reader, 1);
+    cpu->h = get(&reader, 1);
+    cpu->l = get(&reader, 1);
+    cpu->sp = get(&reader, 2);
+    cpu->pc = get(&reader, 2);
+    cpu->ime = get(&reader, 1);
+    cpu->halted = get(&reader, 1);
+    getTimer(&reader, &cpu->timer);
+    gameBoy->frameStart = get(&reader, 8);
+    gameBoy->frames = get(&reader, 4);
+    gameBoy->running = get(&reader, 1);
+    getPPU(&reader, &gameBoy->ppu);
+    initLoopCache(cpu);
+
+    uint16_t romBank = get(&reader, 2);
+    uint16_t lowBank = get(&reader, 2);
+    uint8_t ramBank = get(&reader, 1);
+    if (romBank >= memory->cartridge->romBanks || lowBank >= memory->cartridge->romBanks ||
+        (ramBank && ramBank >= memory->cartridge->ramBanks)) {
+        error("Save state does not match the inserted cartridge");
+        return -1;
+    }
+    memory->romBank = romBank;
+    memory->lowBank = lowBank;
+    memory->ramBank = ramBank;
+    memory->bankHigh = get(&reader, 1);
+    memory->bankMode = get(&reader, 1);
+    memory->ramEnabled = get(&reader, 1);
+    memory->joypad = get(&reader, 1);
+    memory->serialRequest = get(&reader, 1);
+    if (reader.offset + HIGH_MEMORY_SIZE > size) {
+        error("Save state is truncated");
+        return -1;
+    }
+    memcpy(memory->high, buffer + reader.offset, HIGH_MEMORY_SIZE);
+    reader.offset += HIGH_MEMORY_SIZE;
+
+    uint32_t present = get(&reader, 4);
+    for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+        const uint8_t *data = NULL;
+        if (present & (1u << i)) {
+            if (reader.offset + MEMORY_PAGE_SIZE > size) {
+                error("Save state is truncated");
+                return -1;
+            }
+            data = buffer + reader.offset;
+            reader.offset += MEMORY_PAGE_SIZE;
+        }
+        if (setMemoryPage(memory, i, data) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// FNV-1a, used to detect playback desyncs against recorded keyframes
+uint64_t hashState(const uint8_t *buffer, uint32_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ buffer[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,20 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include "gameboy.h"
+
+#define STATE_MAGIC 0x5453424E  // "NBST"
+#define STATE_VERSION 4
+#define STATE_HEADER_SIZE 128   // Upper bound for everything but memory
+#define STATE_MAX_SIZE (STATE_HEADER_SIZE + HIGH_MEMORY_SIZE + RAM_PAGE_COUNT * MEMORY_PAGE_SIZE)
+
+// Serialized emulation state, little-endian and independent of struct
+// layout. The cartridge is not included; state can only be restored into an
+// instance running the same ROM. The PPU's position in the frame is kept, but
+// not its framebuffer, which the following frame redraws.
+uint32_t saveGameBoyState(const GameBoy *gameBoy, uint8_t *buffer);
+int loadGameBoyState(GameBoy *gameBoy, const uint8_t *buffer, uint32_t size);
+uint64_t hashState(const uint8_t *buffer, uint32_t size);
+
+#endif
@@ -0,0 +1,138 @@
+#include "stats.h"
+#include "hosttime.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static atomic_uint nextInstance;
+
+// Creates a stats page named after the pid and a per-process instance
+// number, so every instance in a process can publish its own
+int openStats(Stats *stats, const char *title) {
+    uint32_t instance = atomic_fetch_add(&nextInstance, 1);
+    snprintf(stats->name, sizeof(stats->name), STATS_NAME_PREFIX "%d-%u", (int)getpid(), instance);
+    int fd = shm_open(stats->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        error("Failed to create stats page %s", stats->name);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(StatsPage)) != 0) {
+        error("Failed to size stats page %s", stats->name);
+        close(fd);
+        shm_unlink(stats->name);
+        return -1;
+    }
+    stats->page = mmap(NULL, sizeof(StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats->page == MAP_FAILED) {
+        error("Failed to map stats page %s", stats->name);
+        shm_unlink(stats->name);
+        stats->page = NULL;
+        return -1;
+    }
+
+    // The object starts out zeroed, so readers see magic 0 until this is done
+    StatsPage *page = stats->page;
+    page->version = STATS_VERSION;
+    page->pid = getpid();
+    page->instance = instance;
+    snprintf(page->title, sizeof(page->title), "%s", title);
+    atomic_store_explicit(&page->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    page->magic = STATS_MAGIC;
+    stats->totalFrameNanos = 0;
+    debug("Publishing stats to %s", stats->name);
+    return 0;
+}
+
+#define store(field, value) atomic_store_explicit(&page->field, value, memory_order_relaxed)
+
+// Called once per frame; nine relaxed stores between two sequence bumps
+void publishStats(Stats *stats, const GameBoy *gameBoy, uint64_t frameNanos) {
+    StatsPage *page = stats->page;
+    const CPU *cpu = &gameBoy->cpu;
+    unsigned sequence = atomic_load_explicit(&page->sequence, memory_order_relaxed);
+
+    stats->totalFrameNanos += frameNanos;
+    atomic_store_explicit(&page->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    store(updatedNanos, hostTimeNanos());
+    store(cycles, cpu->timer.cycleCount);
+    store(frames, gameBoy->frames);
+    store(instructions, cpu->instructions);
+    store(frameNanos, frameNanos);
+    store(totalFrameNanos, stats->totalFrameNanos);
+    store(loopCacheHits, cpu->loopCacheHits);
+    store(loopCacheMisses, cpu->loopCacheMisses);
+    store(acceleratedCycles, cpu->acceleratedCycles);
+    atomic_store_explicit(&page->sequence, sequence + 2, memory_order_release);
+}
+
+#undef store
+
+void closeStats(Stats *stats) {
+    if (stats->page) {
+        munmap(stats->page, sizeof(StatsPage));
+        shm_unlink(stats->name);
+        stats->page = NULL;
+    }
+}
+
+// Maps the stats page of a running instance read-only
+const StatsPage *mapStats(pid_t pid, uint32_t instance) {
+    char name[64];
+    snprintf(name, sizeof(name), STATS_NAME_PREFIX "%d-%u", (int)pid, instance);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        error("No stats page for instance %u of process %d", instance, (int)pid);
+        return NULL;
+    }
+    const StatsPage *page = mmap(NULL, sizeof(StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        error("Failed to map stats page %s", name);
+        return NULL;
+    }
+    if (page->magic != STATS_MAGIC || page->version != STATS_VERSION) {
+        error("Stats page %s has an unknown format", name);
+        munmap((void *)page, sizeof(StatsPage));
+        return NULL;
+    }
+    return page;
+}
+
+void unmapStats(const StatsPage *page) {
+    munmap((void *)page, sizeof(StatsPage));
+}
+
+#define load(field) atomic_load_explicit(&((StatsPage *)page)->field, memory_order_relaxed)
+
+// Lock-free consistent read; returns -1 if the writer kept interfering
+int readStats(const StatsPage *page, StatsSnapshot *snapshot) {
+    atomic_uint *sequence = (atomic_uint *)&page->sequence;
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        unsigned before = atomic_load_explicit(sequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        snapshot->updatedNanos = load(updatedNanos);
+        snapshot->cycles = load(cycles);
+        snapshot->frames = load(frames);
+        snapshot->instructions = load(instructions);
+        snapshot->frameNanos = load(frameNanos);
+        snapshot->totalFrameNanos = load(totalFrameNanos);
+        snapshot->loopCacheHits = load(loopCacheHits);
+        snapshot->loopCacheMisses = load(loopCacheMisses);
+        snapshot->acceleratedCycles = load(acceleratedCycles);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(sequence, memory_order_relaxed) == before) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#undef load
@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "config.h"
+#include "gameboy.h"
+
+#define STATS_MAGIC 0x5053424E  // "NBSP"
+#define STATS_VERSION 3
+#define STATS_NAME_PREFIX "/nanoboy-"  // Shared memory object, followed by <pid>-<instance>
+
+// Layout shared with external readers. The writer bumps `sequence` to an odd
+// value, stores the counters and bumps it back to even; readers retry until
+// they see the same even value on both sides of their loads.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t instance;               // Numbered from 0 in each process
+    char title[17];                  // ROM title
+    _Alignas(CACHE_LINE_SIZE) atomic_uint sequence;
+    _Atomic uint64_t updatedNanos;   // Host time of the last update
+    _Atomic uint64_t cycles;         // Emulated cycles
+    _Atomic uint64_t frames;
+    _Atomic uint64_t instructions;   // Instructions interpreted
+    _Atomic uint64_t frameNanos;     // Host time of the last frame
+    _Atomic uint64_t totalFrameNanos;
+    _Atomic uint64_t loopCacheHits;  // Bulk loop decode cache, see idiom.c
+    _Atomic uint64_t loopCacheMisses;
+    _Atomic uint64_t acceleratedCycles;
+} StatsPage;
+
+// Plain copy of the counters taken by a reader
+typedef struct {
+    uint64_t updatedNanos;
+    uint64_t cycles;
+    uint64_t frames;
+    uint64_t instructions;
+    uint64_t frameNanos;
+    uint64_t totalFrameNanos;
+    uint64_t loopCacheHits;
+    uint64_t loopCacheMisses;
+    uint64_t acceleratedCycles;
+} StatsSnapshot;
+
+typedef struct {
+    StatsPage *page;
+    char name[64];
+    uint64_t totalFrameNanos;
+} Stats;
+
+int openStats(Stats *stats, const char *title);
+void publishStats(Stats *stats, const GameBoy *gameBoy, uint64_t frameNanos);
+void closeStats(Stats *stats);
+const StatsPage *mapStats(pid_t pid, uint32_t instance);
+void unmapStats(const StatsPage *page);
+int readStats(const StatsPage *page, StatsSnapshot *snapshot);
+
+#endif
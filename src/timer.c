@@ -1,9 +1,124 @@
 #include "timer.h"
 
+#define TIMER_ENABLE 0x04
+
+// Divider bit whose falling edge clocks TIMA, per TAC input clock select
+static const uint8_t selectedBit[4] = { 9, 3, 5, 7 };
+
+static inline int timerEnabled(const Timer *timer) {
+    return timer->control & TIMER_ENABLE;
+}
+
+static inline uint64_t dividerAt(const Timer *timer, uint64_t cycle) {
+    return cycle - timer->dividerStart;
+}
+
+// Cycles between two falling edges of the selected divider bit
+static inline uint64_t edgePeriod(const Timer *timer) {
+    return 2ull << selectedBit[timer->control & 3];
+}
+
+// Falling edges of the selected bit in (counterStart, now]
+static uint64_t pendingEdges(const Timer *timer) {
+    if (!timerEnabled(timer)) {
+        return 0;
+    }
+    uint64_t period = edgePeriod(timer);
+    return dividerAt(timer, timer->cycleCount) / period -
+           dividerAt(timer, timer->counterStart) / period;
+}
+
 void initTimer(Timer *timer) {
     timer->cycleCount = 0;
+    timer->dividerStart = 0;
+    timer->counterStart = 0;
+    timer->counter = 0;
+    timer->modulo = 0;
+    timer->control = 0xF8;
+    timer->overflowCycle = TIMER_NEVER;
+}
+
+// Finds the cycle of the edge that takes TIMA from 0xFF to 0x00
+void scheduleTimer(Timer *timer) {
+    if (!timerEnabled(timer)) {
+        timer->overflowCycle = TIMER_NEVER;
+        return;
+    }
+    uint64_t period = edgePeriod(timer);
+    uint64_t edges = 0x100 - timer->counter;
+    uint64_t firstEdge = (dividerAt(timer, timer->counterStart) / period + 1) * period;
+    timer->overflowCycle = timer->dividerStart + firstEdge + (edges - 1) * period;
+}
+
+// Applies every overflow up to the current cycle, each at the exact cycle it
+// happened; returns 1 if the timer interrupt should be requested
+int catchUpTimer(Timer *timer) {
+    int overflowed = 0;
+    while (timer->overflowCycle <= timer->cycleCount) {
+        timer->counter = timer->modulo;
+        timer->counterStart = timer->overflowCycle;
+        scheduleTimer(timer);
+        overflowed = 1;
+    }
+    return overflowed;
+}
+
+// Folds the edges seen so far into `counter` before the clock changes
+static void settleTimer(Timer *timer) {
+    timer->counter += pendingEdges(timer);
+    timer->counterStart = timer->cycleCount;
+}
+
+// An edge caused by a register write rather than the divider running on
+static int glitchEdge(Timer *timer) {
+    if (timer->counter++ == 0xFF) {
+        timer->counter = timer->modulo;
+        return 1;
+    }
+    return 0;
+}
+
+static inline int selectedBitHigh(const Timer *timer, uint8_t control) {
+    return (control & TIMER_ENABLE) &&
+           (dividerAt(timer, timer->cycleCount) >> selectedBit[control & 3] & 1);
+}
+
+// Callers catch up first, so TIMA has not passed 0xFF yet
+uint8_t readTimer(Timer *timer, uint16_t address) {
+    switch (address) {
+        case TIMER_DIVIDER: return dividerAt(timer, timer->cycleCount) >> 8;
+        case TIMER_COUNTER: return timer->counter + pendingEdges(timer);
+        case TIMER_MODULO: return timer->modulo;
+        default: return timer->control;
+    }
 }
 
-void addCycles(Timer *timer, uint8_t cycles) {
-    timer->cycleCount += cycles;
+// Returns 1 if the write itself overflowed TIMA
+int writeTimer(Timer *timer, uint16_t address, uint8_t value) {
+    int overflowed = 0;
+    settleTimer(timer);
+    switch (address) {
+        case TIMER_DIVIDER:
+            // Zeroing the divider drops the selected bit if it was high
+            if (selectedBitHigh(timer, timer->control)) {
+                overflowed = glitchEdge(timer);
+            }
+            timer->dividerStart = timer->cycleCount;
+            break;
+        case TIMER_COUNTER:
+            timer->counter = value;
+            break;
+        case TIMER_MODULO:
+            timer->modulo = value;
+            break;
+        default:
+            // Switching clock or disabling can also drop the selected bit
+            if (selectedBitHigh(timer, timer->control) && !selectedBitHigh(timer, value)) {
+                overflowed = glitchEdge(timer);
+            }
+            timer->control = value | 0xF8;
+            break;
+    }
+    scheduleTimer(timer);
+    return overflowed;
 }
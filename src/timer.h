@@ -3,11 +3,33 @@
 
 #include <stdint.h>
 
-typedef struct {
-    uint32_t cycleCount;  
+#define TIMER_DIVIDER 0xFF04
+#define TIMER_COUNTER 0xFF05
+#define TIMER_MODULO 0xFF06
+#define TIMER_CONTROL 0xFF07
+#define INTERRUPT_TIMER 0x04
+#define TIMER_NEVER UINT64_MAX
+
+// DIV and TIMA are never ticked; both are derived from the cycle count when
+// read, and the next TIMA overflow is kept as a scheduled cycle
+typedef struct Timer {
+    uint64_t cycleCount;
+    uint64_t dividerStart;   // Cycle the internal 16-bit divider was last zeroed
+    uint64_t counterStart;   // Cycle at which `counter` was last exact
+    uint64_t overflowCycle;  // Next TIMA overflow, TIMER_NEVER while stopped
+    uint8_t counter;         // TIMA as of `counterStart`
+    uint8_t modulo;
+    uint8_t control;
 } Timer;
 
 void initTimer(Timer *timer);
-void addCycles(Timer *timer, uint8_t cycles);
+void scheduleTimer(Timer *timer);
+int catchUpTimer(Timer *timer);
+uint8_t readTimer(Timer *timer, uint16_t address);
+int writeTimer(Timer *timer, uint16_t address, uint8_t value);
+
+static inline void addCycles(Timer *timer, uint32_t cycles) {
+    timer->cycleCount += cycles;
+}
 
 #endif 
@@ -0,0 +1,342 @@
+#include "trace.h"
+#include "arena.h"
+#include "hosttime.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Lockstep comparison against a reference execution log. The log is read
+// in fixed chunks and parsed in place, so nothing is allocated per line and
+// logs of any length stream through one buffer.
+
+typedef struct {
+    int fd;
+    uint64_t line;                // Line number of the last record
+    uint32_t start, end;          // Unparsed bytes of `buffer`
+    int eof;
+    char buffer[TRACE_BUFFER_SIZE];
+} TraceReader;
+
+_Static_assert(sizeof(TraceReader) <= TRACE_BUFFER_SIZE + CACHE_LINE_SIZE,
+               "Trace reader outgrew its arena reservation");
+
+static const int8_t hexDigits[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8,
+    ['8'] = 9, ['9'] = 10, ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15,
+    ['F'] = 16, ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};  // Digit value + 1, 0 for anything else
+
+static const char *parseHex(const char *p, const char *end, uint16_t *value) {
+    uint16_t result = 0;
+    while (p < end && hexDigits[(uint8_t)*p]) {
+        result = result << 4 | (hexDigits[(uint8_t)*p++] - 1);
+    }
+    *value = result;
+    return p;
+}
+
+// The canonical layout, which nearly every log uses
+#define FIXED_LINE_LENGTH 73  // A:01 F:B0 ... SP:FFFE PC:0100 PCMEM:00,C3,13,02
+
+// Value of n hex digits; sets *bad if any of them is not one
+static inline uint16_t fixedHex(const char *p, int n, int *bad) {
+    uint16_t value = 0;
+    for (int i = 0; i < n; i++) {
+        int digit = hexDigits[(uint8_t)p[i]];
+        *bad |= !digit;
+        value = value << 4 | ((digit - 1) & 0xF);
+    }
+    return value;
+}
+
+// Parses the canonical layout by position; returns 0 for any other layout
+static int parseFixedRecord(const char *line, const char *end, TraceRecord *record) {
+    static const uint8_t offsets[] = { 2, 7, 12, 17, 22, 27, 32, 37, 62, 65, 68, 71 };
+    uint8_t values[sizeof(offsets)];
+    int bad = 0;
+    if (end - line != FIXED_LINE_LENGTH ||
+        line[0] != 'A' || line[5] != 'F' || line[10] != 'B' || line[15] != 'C' ||
+        line[20] != 'D' || line[25] != 'E' || line[30] != 'H' || line[35] != 'L' ||
+        line[40] != 'S' || line[48] != 'P' || line[56] != 'P' || line[61] != ':') {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(offsets); i++) {
+        values[i] = fixedHex(line + offsets[i], 2, &bad);
+    }
+    record->sp = fixedHex(line + 43, 4, &bad);
+    record->pc = fixedHex(line + 51, 4, &bad);
+    if (bad) {
+        return 0;
+    }
+    record->a = values[0]; record->f = values[1];
+    record->b = values[2]; record->c = values[3];
+    record->d = values[4]; record->e = values[5];
+    record->h = values[6]; record->l = values[7];
+    memcpy(record->pcmem, values + 8, TRACE_PCMEM_SIZE);
+    record->pcmemLength = TRACE_PCMEM_SIZE;
+    record->fields = FIELD_A | FIELD_F | FIELD_B | FIELD_C | FIELD_D | FIELD_E | FIELD_H |
+                     FIELD_L | FIELD_SP | FIELD_PC | FIELD_PCMEM;
+    return 1;
+}
+
+// Fills `record` from one line in any field order; returns 0 if it holds
+// no fields at all
+static int parseRecord(const char *p, const char *end, TraceRecord *record) {
+    record->fields = 0;
+    while (p < end) {
+        const char *key = p;
+        while (p < end && *p != ':' && *p != ' ') p++;
+        if (p == end || *p != ':') {
+            p++;
+            continue;
+        }
+        uint32_t keyLength = p++ - key;
+        uint16_t value;
+        if (keyLength == 5 && memcmp(key, "PCMEM", 5) == 0) {
+            record->pcmemLength = 0;
+            do {
+                p = parseHex(p + (p < end && *p == ','), end, &value);
+                record->pcmem[record->pcmemLength++] = (uint8_t)value;
+            } while (p < end && *p == ',' && record->pcmemLength < TRACE_PCMEM_SIZE);
+            record->fields |= FIELD_PCMEM;
+        } else if (keyLength == 2 && (memcmp(key, "SP", 2) == 0 || memcmp(key, "PC", 2) == 0)) {
+            p = parseHex(p, end, &value);
+            if (key[0] == 'S') {
+                record->sp = value;
+                record->fields |= FIELD_SP;
+            } else {
+                record->pc = value;
+                record->fields |= FIELD_PC;
+            }
+        } else if (keyLength == 1) {
+            p = parseHex(p, end, &value);
+            switch (key[0]) {
+                case 'A': record->a = value; record->fields |= FIELD_A; break;
+                case 'F': record->f = value; record->fields |= FIELD_F; break;
+                case 'B': record->b = value; record->fields |= FIELD_B; break;
+                case 'C': record->c = value; record->fields |= FIELD_C; break;
+                case 'D': record->d = value; record->fields |= FIELD_D; break;
+                case 'E': record->e = value; record->fields |= FIELD_E; break;
+                case 'H': record->h = value; record->fields |= FIELD_H; break;
+                case 'L': record->l = value; record->fields |= FIELD_L; break;
+                default: break;
+            }
+        }
+    }
+    return record->fields != 0;
+}
+
+// Returns 1 with the next record, 0 at the end of the log, -1 on errors.
+// Blank lines, comments and lines without known fields are skipped.
+static int readRecord(TraceReader *reader, TraceRecord *record) {
+    for (;;) {
+        char *line = reader->buffer + reader->start;
+        char *newline = memchr(line, '\n', reader->end - reader->start);
+        if (!newline && !reader->eof) {
+            if (reader->start == 0 && reader->end == TRACE_BUFFER_SIZE) {
+                error("Trace line %llu is too long", (unsigned long long)reader->line + 1);
+                return -1;
+            }
+            memmove(reader->buffer, line, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+            ssize_t got = read(reader->fd, reader->buffer + reader->end,
+                               TRACE_BUFFER_SIZE - reader->end);
+            if (got < 0) {
+                error("Failed to read trace log");
+                return -1;
+            }
+            reader->eof = got == 0;
+            reader->end += got;
+            continue;
+        }
+        if (!newline && reader->start == reader->end) {
+            return 0;
+        }
+
+        char *lineEnd = newline ? newline : reader->buffer + reader->end;
+        reader->start = lineEnd - reader->buffer + (newline != NULL);
+        reader->line++;
+        if (lineEnd > line && lineEnd[-1] == '\r') {
+            lineEnd--;
+        }
+        if (parseFixedRecord(line, lineEnd, record) ||
+            (line < lineEnd && *line != '#' && parseRecord(line, lineEnd, record))) {
+            return 1;
+        }
+    }
+}
+
+// Reads code bytes without the catch-up hooks readByte runs for registers
+static uint8_t peekByte(const Memory *memory, uint16_t address) {
+    const uint8_t *byte = readableMemory(memory, address);
+    return byte ? *byte : memory->high[address - HIGH_MEMORY_START];
+}
+
+// PCMEM is only read when the reference line has it, and then straight
+// from the page unless it crosses into the next one
+static void captureRecord(const CPU *cpu, const Memory *memory, const TraceRecord *expected,
+                          TraceRecord *record) {
+    record->a = cpu->a; record->f = cpu->f;
+    record->b = cpu->b; record->c = cpu->c;
+    record->d = cpu->d; record->e = cpu->e;
+    record->h = cpu->h; record->l = cpu->l;
+    record->sp = cpu->sp;
+    record->pc = cpu->pc;
+    record->pcmemLength = 0;
+    if (!(expected->fields & FIELD_PCMEM)) {
+        return;
+    }
+    uint8_t length = expected->pcmemLength;
+    const uint8_t *bytes = readableMemory(memory, cpu->pc);
+    if (bytes && (cpu->pc & (MEMORY_PAGE_SIZE - 1)) + length <= MEMORY_PAGE_SIZE) {
+        memcpy(record->pcmem, bytes, length);
+    } else {
+        for (int i = 0; i < length; i++) {
+            record->pcmem[i] = peekByte(memory, cpu->pc + i);
+        }
+    }
+    record->pcmemLength = length;
+}
+
+// Bits of the fields present in `expected` that `actual` disagrees with
+static uint16_t differingFields(const TraceRecord *expected, const TraceRecord *actual) {
+    uint16_t fields = expected->fields;
+    uint16_t differ = 0;
+    if ((fields & FIELD_A) && expected->a != actual->a) differ |= FIELD_A;
+    if ((fields & FIELD_F) && expected->f != actual->f) differ |= FIELD_F;
+    if ((fields & FIELD_B) && expected->b != actual->b) differ |= FIELD_B;
+    if ((fields & FIELD_C) && expected->c != actual->c) differ |= FIELD_C;
+    if ((fields & FIELD_D) && expected->d != actual->d) differ |= FIELD_D;
+    if ((fields & FIELD_E) && expected->e != actual->e) differ |= FIELD_E;
+    if ((fields & FIELD_H) && expected->h != actual->h) differ |= FIELD_H;
+    if ((fields & FIELD_L) && expected->l != actual->l) differ |= FIELD_L;
+    if ((fields & FIELD_SP) && expected->sp != actual->sp) differ |= FIELD_SP;
+    if ((fields & FIELD_PC) && expected->pc != actual->pc) differ |= FIELD_PC;
+    if ((fields & FIELD_PCMEM) &&
+        memcmp(expected->pcmem, actual->pcmem, expected->pcmemLength) != 0) {
+        differ |= FIELD_PCMEM;
+    }
+    return differ;
+}
+
+static void printRecord(const char *label, const TraceRecord *record, uint16_t marks) {
+    fprintf(stderr, "%-9s A:%02X%c F:%02X%c B:%02X%c C:%02X%c D:%02X%c E:%02X%c H:%02X%c L:%02X%c "
+            "SP:%04X%c PC:%04X%c PCMEM:", label,
+            record->a, marks & FIELD_A ? '*' : ' ', record->f, marks & FIELD_F ? '*' : ' ',
+            record->b, marks & FIELD_B ? '*' : ' ', record->c, marks & FIELD_C ? '*' : ' ',
+            record->d, marks & FIELD_D ? '*' : ' ', record->e, marks & FIELD_E ? '*' : ' ',
+            record->h, marks & FIELD_H ? '*' : ' ', record->l, marks & FIELD_L ? '*' : ' ',
+            record->sp, marks & FIELD_SP ? '*' : ' ', record->pc, marks & FIELD_PC ? '*' : ' ');
+    for (int i = 0; i < record->pcmemLength; i++) {
+        fprintf(stderr, "%s%02X", i ? "," : "", record->pcmem[i]);
+    }
+    fprintf(stderr, "%s\n", marks & FIELD_PCMEM ? "*" : "");
+}
+
+static void reportDivergence(const TraceRecord *context, uint64_t matched, uint64_t line,
+                             const TraceRecord *expected, const TraceRecord *actual,
+                             uint16_t differ) {
+    int shown = matched < TRACE_CONTEXT ? (int)matched : TRACE_CONTEXT;
+    error("Diverged from the reference at line %llu after %llu instructions",
+          (unsigned long long)line, (unsigned long long)matched);
+    for (int i = shown; i > 0; i--) {
+        printRecord("matched", &context[(matched - i) % TRACE_CONTEXT], 0);
+    }
+    printRecord("expected", expected, differ);
+    printRecord("actual", actual, differ);
+}
+
+// Seeds the CPU from the first record, since reference logs usually start
+// after the boot ROM, then checks the state before every instruction.
+// Accelerated loops are followed by skipping the reference lines of the
+// iterations they cover. Stops after `limit` records if nonzero. Returns 0
+// if the whole log matched.
+int compareTrace(GameBoy *gameBoy, const char *logPath, uint64_t limit) {
+    CPU *cpu = &gameBoy->cpu;
+    Memory *memory = &gameBoy->memory;
+    TraceRecord context[TRACE_CONTEXT];
+    TraceRecord expected, actual;
+    uint64_t matched = 0, skipped = 0;
+    int status = 0, got;
+
+    Arena *arena = memory->arena;
+    TraceReader *reader = allocArenaObject(arena, sizeof(TraceReader));
+    if (!reader) {
+        return -1;
+    }
+    reader->fd = strcmp(logPath, "-") == 0 ? STDIN_FILENO : open(logPath, O_RDONLY);
+    reader->line = 0;
+    reader->start = reader->end = 0;
+    reader->eof = 0;
+    if (reader->fd < 0) {
+        error("Failed to open trace log: %s", logPath);
+        freeArenaObject(arena, reader, sizeof(TraceReader));
+        return -1;
+    }
+
+    uint64_t start = hostTimeNanos();
+    if ((got = readRecord(reader, &expected)) > 0) {
+        if (expected.fields & FIELD_A) cpu->a = expected.a;
+        if (expected.fields & FIELD_F) cpu->f = expected.f;
+        if (expected.fields & FIELD_B) cpu->b = expected.b;
+        if (expected.fields & FIELD_C) cpu->c = expected.c;
+        if (expected.fields & FIELD_D) cpu->d = expected.d;
+        if (expected.fields & FIELD_E) cpu->e = expected.e;
+        if (expected.fields & FIELD_H) cpu->h = expected.h;
+        if (expected.fields & FIELD_L) cpu->l = expected.l;
+        if (expected.fields & FIELD_SP) cpu->sp = expected.sp;
+        if (expected.fields & FIELD_PC) cpu->pc = expected.pc;
+    }
+    while (got > 0) {
+        captureRecord(cpu, memory, &expected, &actual);
+        uint16_t differ = differingFields(&expected, &actual);
+        if (differ) {
+            reportDivergence(context, matched, reader->line, &expected, &actual, differ);
+            status = -1;
+            break;
+        }
+        context[matched++ % TRACE_CONTEXT] = actual;
+        if (limit && matched + skipped >= limit) {
+            break;
+        }
+        if (cpu->halted) {
+            error("CPU halted at 0x%04X with the reference log still running", cpu->pc);
+            status = -1;
+            break;
+        }
+
+        uint16_t pc = cpu->pc;
+        uint32_t loops = cpu->acceleratedLoops;
+        executeNextInstruction(cpu, memory);
+        got = readRecord(reader, &expected);
+        if (cpu->acceleratedLoops != loops) {
+            // The JR at `pc` jumped back into a loop that then ran to completion
+            uint16_t loopStart = pc + 2 + (int8_t)peekByte(memory, pc + 1);
+            while (got > 0 && (expected.fields & FIELD_PC) &&
+                   expected.pc >= loopStart && expected.pc <= pc) {
+                skipped++;
+                got = readRecord(reader, &expected);
+            }
+        }
+    }
+    if (got < 0) {
+        status = -1;
+    }
+    uint64_t nanos = hostTimeNanos() - start;
+
+    if (status == 0) {
+        success("Matched %llu instructions of %s (%llu more covered by accelerated loops)",
+                (unsigned long long)matched, logPath, (unsigned long long)skipped);
+    }
+    info("Compared %llu lines in %.1f ms, %.1f M instructions/s",
+         (unsigned long long)reader->line, nanos / 1e6,
+         nanos ? (matched + skipped) * 1e3 / nanos : 0.0);
+    if (reader->fd != STDIN_FILENO) {
+        close(reader->fd);
+    }
+    freeArenaObject(arena, reader, sizeof(TraceReader));
+    return status;
+}
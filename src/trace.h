@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "gameboy.h"
+
+#define TRACE_BUFFER_SIZE (1 << 16)  // Read chunk, also the longest accepted line
+#define TRACE_CONTEXT 8              // Matched records shown before a divergence
+#define TRACE_PCMEM_SIZE 4
+
+typedef enum {
+    FIELD_A = 1 << 0, FIELD_F = 1 << 1, FIELD_B = 1 << 2, FIELD_C = 1 << 3,
+    FIELD_D = 1 << 4, FIELD_E = 1 << 5, FIELD_H = 1 << 6, FIELD_L = 1 << 7,
+    FIELD_SP = 1 << 8, FIELD_PC = 1 << 9, FIELD_PCMEM = 1 << 10
+} TraceField;
+
+// One reference log line, in the widely used text format
+//   A:01 F:B0 B:00 C:13 D:00 E:D8 H:01 L:4D SP:FFFE PC:0100 PCMEM:00,C3,13,02
+// holding the state before the instruction at PC runs. Fields may come in
+// any order; missing ones are not compared.
+typedef struct {
+    uint8_t a, f, b, c, d, e, h, l;
+    uint16_t sp, pc;
+    uint8_t pcmem[TRACE_PCMEM_SIZE];
+    uint8_t pcmemLength;
+    uint16_t fields;  // TraceField bits present on the line
+} TraceRecord;
+
+int compareTrace(GameBoy *gameBoy, const char *logPath, uint64_t limit);
+
+#endif
@@ -21,16 +21,25 @@
 #define debug(S, ...)
 #endif
 
+#ifdef DEBUG
 #define p_instr(S, ...)                                                           \
   do {                                                                         \
     fprintf(stderr, KBLU "INSTR: " KNRM S NL,##__VA_ARGS__); \
   } while (0)
+#else
+#define p_instr(S, ...)
+#endif
 
 #define error(S, ...)                                                          \
     do {                                                                       \
         fprintf(stderr, KRED "ERROR: " KNRM S NL, ##__VA_ARGS__); \
     } while (0)
 
+#define info(S, ...)                                                           \
+  do {                                                                         \
+    fprintf(stderr, KBLU "INFO: " KNRM S NL, ##__VA_ARGS__);                   \
+  } while (0)
+
 #define success(S, ...)                                                        \
   do {                                                                         \
     fprintf(stderr, KGRN "SUCCESS: " KNRM S NL, ##__VA_ARGS__);                \
@@ -38,12 +47,39 @@
 
 #define USAGE(program_name, retcode) do { \
     fprintf(stderr, "USAGE: %s %s\n", program_name, \
-    "[-h|--help] -s|--step <cycles> | -r|--run <ROM file>\n" \
+    "[-h|--help] -s|--step <cycles> | -r|--run | -a|--run-ahead <frames> | -f|--fork <count> | -l|--link <frames> <ROM file> | -t|--test <directory> | -d|--diff <log> <ROM file>\n" \
     "   -h, --help    Show this help message.\n" \
     "   -s, --step    Run the emulator for the specified number of cycles.\n" \
     "                 Usage: -s <cycles> <ROM file>\n" \
-    "   -r, --run     Run the emulator in an infinite loop.\n" \
-    "                 Usage: -r <ROM file>\n"); \
+    "   -r, --run     Run the emulator in real time until interrupted.\n" \
+    "                 Usage: -r <ROM file> [--turbo] [--speed <multiplier>]\n" \
+    "                 [--histogram <CSV file>] [--record <movie file>]\n" \
+    "                 [--play <movie file> [--seek <frame>]]\n" \
+    "                 [--heatmap <file[.csv]>] (build/heatmap/nanoboy from 'make heatmap')\n" \
+    "                 [--stats] (read live with build/nanostat <pid>[/<instance>])\n" \
+    "                 [--frames-out <fd|file> [--frames-format raw|delta]\n" \
+    "                 [--sync-frames]] (pace to the frame reader, not the clock)\n" \
+    "                 [--save <file>] (battery RAM, default <ROM>.sav)\n" \
+    "                 [--ppu scanline|fifo] (fifo shows mid-line effects)\n" \
+    "   -a, --run-ahead  Run with the given number of frames of run-ahead and\n" \
+    "                 report its per-frame host cost.\n" \
+    "                 Usage: -a <frames> <ROM file> [--second-instance]\n" \
+    "                 [--frames <n>] (stop after n frames, default on Ctrl-C)\n" \
+    "   -f, --fork    Fork the given number of copy-on-write instances and\n" \
+    "                 report clone latency and resident memory per fork.\n" \
+    "                 Usage: -f <count> <ROM file>\n" \
+    "   -l, --link    Run two instances connected by a link cable on separate\n" \
+    "                 threads and compare their speed to an unlinked one.\n" \
+    "                 Usage: -l <frames> <ROM file>\n" \
+    "   -t, --test    Run every test ROM in a directory in parallel and report\n" \
+    "                 pass/fail, emulated cycles and host time per ROM.\n" \
+    "                 Usage: -t <directory> [--budget <cycles>] [--jobs <n>]\n" \
+    "                 [--report <CSV file>] [--ppu scanline|fifo]\n" \
+    "                 [--compare-ppu] (passes must draw the same frame on both)\n" \
+    "   -d, --diff    Step the CPU in lockstep with a reference log (one line\n" \
+    "                 of registers per instruction, '-' for stdin) and stop at\n" \
+    "                 the first divergence.\n" \
+    "                 Usage: -d <log file> <ROM file> [--limit <instructions>]\n"); \
     exit(retcode); \
 } while (0)
 
@@ -0,0 +1,45 @@
+#include "video.h"
+#include <string.h>
+
+void readLineRegisters(const Memory *memory, LineRegisters *registers) {
+    registers->control = memory->high[LCD_CONTROL - HIGH_MEMORY_START];
+    registers->scrollY = memory->high[SCROLL_Y - HIGH_MEMORY_START];
+    registers->scrollX = memory->high[SCROLL_X - HIGH_MEMORY_START];
+    registers->palette = memory->high[BG_PALETTE - HIGH_MEMORY_START];
+}
+
+// Tile index at background map position (row, column), in pixels
+uint8_t backgroundTile(const Memory *memory, uint8_t control, uint8_t row, uint8_t column) {
+    uint16_t map = control & LCDC_BG_MAP ? 0x9C00 : 0x9800;
+    return vram(memory, map + (row >> 3) * 32 + (column >> 3));
+}
+
+// Address of the low bitplane of pixel row `row` of a tile
+uint16_t tileRowAddress(uint8_t control, uint8_t tile, uint8_t row) {
+    uint16_t data = control & LCDC_TILE_DATA
+        ? 0x8000 + tile * 16
+        : 0x9000 + (int8_t)tile * 16;
+    return data + (row & 7) * 2;
+}
+
+// Draws background line `line` as the given registers describe it
+void renderLine(const Memory *memory, const LineRegisters *registers, int line, uint8_t *out) {
+    if (!(registers->control & LCDC_BG_ENABLE)) {
+        memset(out, 0, FRAME_WIDTH);
+        return;
+    }
+
+    uint8_t row = registers->scrollY + line;
+    for (int x = 0; x < FRAME_WIDTH; ) {
+        uint8_t column = registers->scrollX + x;
+        uint8_t tile = backgroundTile(memory, registers->control, row, column);
+        uint16_t data = tileRowAddress(registers->control, tile, row);
+        uint8_t low = vram(memory, data);
+        uint8_t high = vram(memory, data + 1);
+        // Finish this tile's row before fetching the next one
+        for (int bit = 7 - (column & 7); bit >= 0 && x < FRAME_WIDTH; bit--, x++) {
+            int color = ((high >> bit) & 1) << 1 | ((low >> bit) & 1);
+            out[x] = (registers->palette >> (color * 2)) & 3;
+        }
+    }
+}
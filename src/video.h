@@ -0,0 +1,32 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdint.h>
+#include "memory.h"
+
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 144
+#define FRAME_PIXELS (FRAME_WIDTH * FRAME_HEIGHT)
+
+#define LCDC_ENABLE    0x80
+#define LCDC_TILE_DATA 0x10  // Tiles at 0x8000 with unsigned indices, else 0x9000 signed
+#define LCDC_BG_MAP    0x08  // Background map at 0x9C00 instead of 0x9800
+#define LCDC_BG_ENABLE 0x01
+
+// Registers that shape a background line
+typedef struct {
+    uint8_t control, scrollY, scrollX, palette;
+} LineRegisters;
+
+// VRAM as the PPU sees it, bypassing the CPU's access hooks
+static inline uint8_t vram(const Memory *memory, uint16_t address) {
+    return memory->read[address >> MEMORY_PAGE_SHIFT][address & (MEMORY_PAGE_SIZE - 1)];
+}
+
+// Pixels are shade indices 0-3 (white to black) after the BGP palette
+void readLineRegisters(const Memory *memory, LineRegisters *registers);
+uint8_t backgroundTile(const Memory *memory, uint8_t control, uint8_t row, uint8_t column);
+uint16_t tileRowAddress(uint8_t control, uint8_t tile, uint8_t row);
+void renderLine(const Memory *memory, const LineRegisters *registers, int line, uint8_t *out);
+
+#endif
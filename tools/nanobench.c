@@ -0,0 +1,765 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "arena.h"
+#include "framestream.h"
+#include "gameboy.h"
+#include "movie.h"
+#include "runahead.h"
+#include "hosttime.h"
+#include "state.h"
+#include "video.h"
+#include "utils.h"
+
+// Micro-benchmarks for the core hot paths. Every benchmark runs a fixed
+// number of operations per run; after the warm-up runs, the per-operation
+// times of the timed runs are sorted to report median and percentiles.
+
+#define BENCH_DEFAULT_RUNS 51
+#define BENCH_DEFAULT_WARMUP 5
+#define BENCH_DEFAULT_THRESHOLD 10.0  // Percent slower than baseline that fails
+#define BENCH_MAX_RUNS 1001
+#define BENCH_MAX 16
+#define PROGRAM_START 0x0150
+#define PROGRAM_END 0x7F00    // Execution restarts before running off bank 1
+#define ALLOC_CHECK_RUNAHEAD 2
+#define ALLOC_CHECK_STATE_INTERVAL 60  // Frames between save state round trips
+#define ALLOC_CHECK_FORKS 4            // Nested forks run off every frame of the last third
+#define STATE_CHECK_FRAMES 300
+#define STATE_CHECK_SEEKS { 250, 50, 240 }  // Between, before and on keyframes
+
+typedef struct {
+    const char *name;
+    const char *unit;      // What one operation is
+    uint32_t operations;   // Per run
+    void (*run)(GameBoy *gameBoy, uint32_t operations);
+    const uint8_t *program;  // Repeated over the ROM, NULL for none
+    uint32_t programSize;
+} Benchmark;
+
+typedef struct {
+    double median, p90, p99, min;  // Nanoseconds per operation
+} BenchResult;
+
+static volatile uint32_t sink;  // Keeps results of pure reads alive
+static uint8_t stateBuffer[STATE_MAX_SIZE];
+static uint32_t stateSize;
+static uint8_t pixels[FRAME_PIXELS];
+
+// Loads, register moves, 16 bit steps and stack traffic, no branches, so
+// the idiom accelerator never takes over
+static const uint8_t dispatchProgram[] = {
+    0x41, 0x14, 0x7E, 0x77, 0x23, 0x5F, 0x0C, 0x3E, 0x12, 0xC5, 0xC1, 0x2B, 0x00, 0x1A,
+};
+
+// The dispatch mix closed into a loop, for whole frames through the run loop
+static const uint8_t frameProgram[] = {
+    0x41, 0x14, 0x7E, 0x77, 0x23, 0x5F, 0x0C, 0x3E, 0x12, 0xC5, 0xC1, 0x2B, 0x00, 0x1A,
+    0x18, 0xF0,
+};
+
+// Reads LY and DIV and writes SCY and TIMA, so the PPU and the timer catch
+// up on every pass, while HL sweeps stores over VRAM and cartridge RAM
+static const uint8_t workloadProgram[] = {
+    0xF0, 0x44, 0xE0, 0x42, 0xF0, 0x04, 0xE0, 0x05,  // LDH A,(LY); LDH (SCY),A; DIV -> TIMA
+    0x22, 0x7C, 0xFE, 0xC0, 0x20, 0xF2,              // LD (HL+),A; until H reaches $C0
+    0x26, 0x80, 0x18, 0xEE,                          // LD H,$80; back to the start
+};
+
+// Every ALU flag helper: ADD, ADC, SUB, SBC, AND, XOR, OR, CP, INC, DEC, DAA
+static const uint8_t aluProgram[] = {
+    0x80, 0x89, 0x92, 0x9B, 0xA4, 0xAD, 0xB0, 0xB9, 0x3C, 0x05, 0xC6, 0x37, 0xFE, 0x90, 0x27,
+    0x2F, 0x3F, 0xE6, 0xF0, 0xEE, 0x0F, 0xF6, 0x01, 0xCE, 0x11, 0xD6, 0x22, 0xDE, 0x33,
+};
+
+static void runInstructions(GameBoy *gameBoy, uint32_t operations) {
+    CPU *cpu = &gameBoy->cpu;
+    for (uint32_t i = 0; i < operations; i++) {
+        if (cpu->pc >= PROGRAM_END) {
+            cpu->pc = PROGRAM_START;
+            cpu->h = 0xC0;
+            cpu->l = 0x00;
+        }
+        executeNextInstruction(cpu, &gameBoy->memory);
+    }
+}
+
+static void runFrames(GameBoy *gameBoy, uint32_t operations) {
+    gameBoy->cpu.h = 0xC0;  // Keep the loop's stores in WRAM
+    for (uint32_t i = 0; i < operations; i++) {
+        runGameBoyFrame(gameBoy);
+    }
+}
+
+// Spread over ROM, WRAM and HRAM the way game code mixes them
+static uint16_t mixedAddress(uint32_t i) {
+    static const uint16_t bases[4] = { 0x0150, 0x4000, 0xC000, 0xFF80 };
+    return bases[i & 3] + (i * 7 & 0x3F);
+}
+
+static void runReadByte(GameBoy *gameBoy, uint32_t operations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < operations; i++) {
+        sum += readByte(&gameBoy->memory, mixedAddress(i));
+    }
+    sink = sum;
+}
+
+static void runReadWord(GameBoy *gameBoy, uint32_t operations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < operations; i++) {
+        sum += readWord(&gameBoy->memory, mixedAddress(i));
+    }
+    sink = sum;
+}
+
+static void runWriteByte(GameBoy *gameBoy, uint32_t operations) {
+    for (uint32_t i = 0; i < operations; i++) {
+        uint16_t address = i & 1 ? 0xFF80 + (i & 0x3F) : 0xC000 + (i & 0x1FFF);
+        writeByte(&gameBoy->memory, address, (uint8_t)i);
+    }
+}
+
+// One background line at a time, as the scanline engine draws them
+static void runTileDecode(GameBoy *gameBoy, uint32_t operations) {
+    LineRegisters registers;
+    readLineRegisters(&gameBoy->memory, &registers);
+    for (uint32_t i = 0; i < operations; i++) {
+        int line = i % FRAME_HEIGHT;
+        registers.scrollX = (uint8_t)i;
+        renderLine(&gameBoy->memory, &registers, line, &pixels[line * FRAME_WIDTH]);
+    }
+    sink = pixels[0];
+}
+
+// A full frame of PPU time with the CPU standing still
+static void runPPUFrames(GameBoy *gameBoy, uint32_t operations) {
+    for (uint32_t i = 0; i < operations; i++) {
+        gameBoy->cpu.timer.cycleCount += CYCLES_PER_FRAME;
+        runPPU(&gameBoy->ppu, &gameBoy->memory);
+    }
+}
+
+static void runScanlinePPU(GameBoy *gameBoy, uint32_t operations) {
+    selectPPUEngine(&gameBoy->ppu, PPU_SCANLINE);
+    runPPUFrames(gameBoy, operations);
+}
+
+static void runFifoPPU(GameBoy *gameBoy, uint32_t operations) {
+    selectPPUEngine(&gameBoy->ppu, PPU_FIFO);
+    runPPUFrames(gameBoy, operations);
+}
+
+static void runSnapshot(GameBoy *gameBoy, uint32_t operations) {
+    for (uint32_t i = 0; i < operations; i++) {
+        stateSize = saveGameBoyState(gameBoy, stateBuffer);
+    }
+}
+
+static void runRestore(GameBoy *gameBoy, uint32_t operations) {
+    for (uint32_t i = 0; i < operations; i++) {
+        if (loadGameBoyState(gameBoy, stateBuffer, stateSize) != 0) {
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static const Benchmark benchmarks[] = {
+    { "dispatch", "instruction", 200000, runInstructions, dispatchProgram, sizeof(dispatchProgram) },
+    { "alu", "instruction", 200000, runInstructions, aluProgram, sizeof(aluProgram) },
+    { "readByte", "read", 500000, runReadByte, NULL, 0 },
+    { "readWord", "read", 500000, runReadWord, NULL, 0 },
+    { "writeByte", "write", 500000, runWriteByte, NULL, 0 },
+    { "frame", "frame", 20, runFrames, frameProgram, sizeof(frameProgram) },
+    { "tileDecode", "line", 20 * FRAME_HEIGHT, runTileDecode, NULL, 0 },
+    { "ppuScanline", "frame", 20, runScanlinePPU, NULL, 0 },
+    { "ppuFifo", "frame", 20, runFifoPPU, NULL, 0 },
+    { "snapshot", "state", 200, runSnapshot, NULL, 0 },
+    { "restore", "state", 200, runRestore, NULL, 0 },
+};
+
+#define BENCHMARK_COUNT (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// 32KB ROM with the benchmark program repeated from PROGRAM_START, VRAM
+// filled with tile data and a map, and the background switched on. NULL
+// `arena` reserves a default one.
+static int setupGameBoy(GameBoy *gameBoy, const Benchmark *benchmark, Arena *arena) {
+    static uint8_t rom[2 * ROM_BANK_SIZE];
+    memset(rom, 0, sizeof(rom));
+    rom[0x0147] = 0x03;  // MBC1 with RAM, so snapshots carry cartridge RAM too
+    rom[0x0149] = 0x02;
+    for (uint32_t i = PROGRAM_START; benchmark->program && i < sizeof(rom); i++) {
+        rom[i] = benchmark->program[(i - PROGRAM_START) % benchmark->programSize];
+    }
+
+    Cartridge *cartridge = loadCartridgeFromMemory(rom, sizeof(rom));
+    if (!cartridge || initGameBoy(gameBoy, arena) != 0) {
+        releaseCartridge(cartridge);
+        return -1;
+    }
+    insertGameBoyCartridge(gameBoy, cartridge);
+    releaseCartridge(cartridge);
+
+    Memory *memory = &gameBoy->memory;
+    uint32_t seed = 0x12345678;
+    for (uint16_t address = 0x8000; address < 0xA000; address++) {
+        seed = seed * 1103515245 + 12345;
+        writeByte(memory, address, seed >> 16);
+    }
+    writeByte(memory, 0x0000, 0x0A);  // Enable cartridge RAM
+    for (uint16_t address = 0xA000; address < 0xC000; address += 0x40) {
+        writeByte(memory, address, (uint8_t)address);
+    }
+    memory->high[LCD_CONTROL - HIGH_MEMORY_START] = 0x91;
+    memory->high[BG_PALETTE - HIGH_MEMORY_START] = 0xE4;
+    gameBoy->cpu.pc = PROGRAM_START;
+    gameBoy->cpu.sp = 0xFFFE;
+    stateSize = saveGameBoyState(gameBoy, stateBuffer);
+    return 0;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, int percent) {
+    int rank = (percent * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static int runBenchmark(const Benchmark *benchmark, int warmup, int runs, BenchResult *result) {
+    static double samples[BENCH_MAX_RUNS];
+    GameBoy *gameBoy = aligned_alloc(CACHE_LINE_SIZE, sizeof(GameBoy));
+    if (!gameBoy || setupGameBoy(gameBoy, benchmark, NULL) != 0) {
+        error("Failed to set up benchmark %s", benchmark->name);
+        free(gameBoy);
+        return -1;
+    }
+
+    for (int i = 0; i < warmup; i++) {
+        benchmark->run(gameBoy, benchmark->operations);
+    }
+    for (int i = 0; i < runs; i++) {
+        uint64_t start = hostTimeNanos();
+        benchmark->run(gameBoy, benchmark->operations);
+        samples[i] = (double)(hostTimeNanos() - start) / benchmark->operations;
+    }
+    qsort(samples, runs, sizeof(double), compareDoubles);
+    result->min = samples[0];
+    result->median = percentile(samples, runs, 50);
+    result->p90 = percentile(samples, runs, 90);
+    result->p99 = percentile(samples, runs, 99);
+
+    freeGameBoy(gameBoy);
+    free(gameBoy);
+    return 0;
+}
+
+// Heap calls made while `countingHeap` is set. The Makefile links nanobench
+// with --wrap for each of these, so calls from the core end up here.
+static int countingHeap;
+static uint64_t heapCalls;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    heapCalls += countingHeap;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    heapCalls += countingHeap;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    heapCalls += countingHeap;
+    return __real_realloc(pointer, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+    heapCalls += countingHeap;
+    return __real_aligned_alloc(alignment, size);
+}
+
+typedef struct {
+    GameBoy *gameBoy;
+    RunAhead runAhead;
+    Movie movie;
+    FrameWriter frames;
+    GameBoy forks[ALLOC_CHECK_FORKS];
+} AllocCheck;
+
+// One front end frame: record the input, run ahead, stream the result and
+// now and then flush the save file and round trip a save state
+static void runCheckedFrame(AllocCheck *check, uint32_t frame) {
+    GameBoy *gameBoy = check->gameBoy;
+    setGameBoyInput(gameBoy, (uint8_t)(frame / 8));
+    if (recordMovieFrame(&check->movie, gameBoy) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    runAheadFrame(&check->runAhead, gameBoy, (uint8_t)(frame / 8), NULL, NULL);
+    memcpy(frameWriterBuffer(&check->frames), gameBoy->ppu.frame->pixels, FRAME_PIXELS);
+    submitFrame(&check->frames, gameBoy->frames);
+    if (frame % ALLOC_CHECK_STATE_INTERVAL == 0) {
+        flushBattery(&gameBoy->memory, 1);
+        stateSize = saveGameBoyState(gameBoy, stateBuffer);
+        if (loadGameBoyState(gameBoy, stateBuffer, stateSize) != 0) {
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// A search over the frame just run: a chain of forks, each forked off the
+// one before, writing to every RAM page it maps and run a frame further
+// with its own input, every other one drawing. All of them are alive at
+// once, next to the run-ahead shadow.
+static void runCheckedForks(AllocCheck *check, uint32_t frame) {
+    GameBoy *parent = check->gameBoy;
+    for (int i = 0; i < ALLOC_CHECK_FORKS; i++) {
+        forkGameBoy(&check->forks[i], parent);
+        if (i & 1) {
+            setGameBoyHeadless(&check->forks[i]);
+        }
+        for (uint32_t address = 0x8000; address < 0xE000; address += MEMORY_PAGE_SIZE) {
+            writeByte(&check->forks[i].memory, address, (uint8_t)frame);
+        }
+        setGameBoyInput(&check->forks[i], (uint8_t)(frame + i));
+        runGameBoyFrame(&check->forks[i]);
+        parent = &check->forks[i];
+    }
+    for (int i = ALLOC_CHECK_FORKS - 1; i >= 0; i--) {
+        freeGameBoy(&check->forks[i]);
+    }
+}
+
+// Runs frames the way a front end does, with a save file attached, a movie
+// being recorded and frames streamed out. The first third uses single
+// instance run-ahead, the rest a second instance, and the last third also
+// runs nested forks off every frame. Fails if anything past the first
+// frame of each run-ahead mode touches the heap, or if the arena, sized for
+// those forks, runs out.
+static int checkAllocations(uint32_t frames) {
+    static const Benchmark workload = {
+        "workload", "frame", 0, NULL, workloadProgram, sizeof(workloadProgram)
+    };
+    static AllocCheck check;
+    char savePath[64], moviePath[64];
+    snprintf(savePath, sizeof(savePath), "/tmp/nanobench-%d.sav", (int)getpid());
+    snprintf(moviePath, sizeof(moviePath), "/tmp/nanobench-%d.nbm", (int)getpid());
+
+    // The run-ahead shadow and the chain of forks are alive at once
+    ArenaConfig config = { .forks = 1 + ALLOC_CHECK_FORKS };
+    Arena *arena = createArena(&config);
+    GameBoy *gameBoy = check.gameBoy = aligned_alloc(CACHE_LINE_SIZE, sizeof(GameBoy));
+    if (!arena || !gameBoy || setupGameBoy(gameBoy, &workload, arena) != 0) {
+        error("Failed to set up allocation check");
+        releaseArena(arena);
+        free(gameBoy);
+        return -1;
+    }
+    releaseArena(arena);  // The instance holds its own reference now
+    gameBoy->cpu.h = 0x80;
+    gameBoy->cpu.l = 0x00;
+    writeByte(&gameBoy->memory, 0xFF07, 0x05);  // Timer on, so TIMA overflows are scheduled
+    if (attachBattery(&gameBoy->memory, savePath) != 0 ||
+        startMovieRecording(&check.movie, moviePath, gameBoy) != 0 ||
+        startFrameWriter(&check.frames, "/dev/null", FRAMES_DELTA) != 0) {
+        error("Failed to set up allocation check");
+        return -1;
+    }
+
+    uint32_t third = frames / 3;
+    initRunAhead(&check.runAhead, RUNAHEAD_SINGLE, ALLOC_CHECK_RUNAHEAD);
+    for (uint32_t i = 0; i <= frames; i++) {
+        if (i == third + 1) {
+            freeRunAhead(&check.runAhead);
+            initRunAhead(&check.runAhead, RUNAHEAD_SECOND_INSTANCE, ALLOC_CHECK_RUNAHEAD);
+        }
+        // The first frame of each mode sets up its buffers
+        countingHeap = i != 0 && i != third + 1;
+        runCheckedFrame(&check, i);
+        if (i > 2 * third) {
+            runCheckedForks(&check, i);
+        }
+    }
+    countingHeap = 0;
+
+    info("Allocation check: %u frames, %llu heap calls, %u pages and %u objects past the arena",
+         frames, (unsigned long long)heapCalls, arena->heapPages, arena->heapObjects);
+    int result = heapCalls || arena->heapPages || arena->heapObjects ? -1 : 0;
+    stopFrameWriter(&check.frames);
+    if (closeMovie(&check.movie) != 0) {
+        result = -1;
+    }
+    freeRunAhead(&check.runAhead);
+    freeGameBoy(gameBoy);
+    free(gameBoy);
+    remove(savePath);
+    remove(moviePath);
+    if (result != 0) {
+        error("The emulation loop allocated after startup");
+    }
+    return result;
+}
+
+// Forks headless instances off one set up the way the benchmarks are and
+// runs each for a second of the frame loop, then fails if the average
+// footprint, the parent's picture and pages shared out included, is over
+// the per-instance budget
+static int checkResident(uint32_t instances) {
+    static const Benchmark frames = {
+        "frame", "frame", 0, NULL, frameProgram, sizeof(frameProgram)
+    };
+    GameBoy *gameBoy = aligned_alloc(CACHE_LINE_SIZE, sizeof(GameBoy));
+    GameBoy *children = aligned_alloc(CACHE_LINE_SIZE, instances * sizeof(GameBoy));
+    if (!gameBoy || !children || setupGameBoy(gameBoy, &frames, NULL) != 0) {
+        error("Failed to set up resident check");
+        free(gameBoy);
+        free(children);
+        return -1;
+    }
+
+    runFrames(gameBoy, 1);
+    uint64_t bytes = gameBoyResidentBytes(gameBoy);
+    for (uint32_t i = 0; i < instances; i++) {
+        forkGameBoy(&children[i], gameBoy);
+        setGameBoyHeadless(&children[i]);
+        children[i].cpu.a = (uint8_t)i;
+        runFrames(&children[i], 60);
+    }
+    for (uint32_t i = 0; i < instances; i++) {
+        bytes += gameBoyResidentBytes(&children[i]);
+    }
+    bytes /= instances + 1;
+
+    info("Resident check: %u forks, %llu bytes per instance (budget %d), %zu bytes fixed",
+         instances, (unsigned long long)bytes, GAMEBOY_RESIDENT_BUDGET, sizeof(GameBoy));
+    for (uint32_t i = 0; i < instances; i++) {
+        freeGameBoy(&children[i]);
+    }
+    freeGameBoy(gameBoy);
+    free(children);
+    free(gameBoy);
+    if (bytes > GAMEBOY_RESIDENT_BUDGET) {
+        error("Instances are over the resident budget");
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t expectedState[STATE_MAX_SIZE];
+static uint32_t expectedSize;
+
+static void expectState(const GameBoy *gameBoy) {
+    expectedSize = saveGameBoyState(gameBoy, expectedState);
+}
+
+static int isExpectedState(const GameBoy *gameBoy) {
+    uint32_t size = saveGameBoyState(gameBoy, stateBuffer);
+    return size == expectedSize && memcmp(stateBuffer, expectedState, size) == 0;
+}
+
+// A fork's writes, to every kind of RAM and over frames of its own, never
+// show in its parent
+static int checkForkIsolation(GameBoy *gameBoy) {
+    static GameBoy child;
+    static const uint16_t addresses[] = { 0x8000, 0x9FFF, 0xA000, 0xC000, 0xDFFF, 0xFE00, 0xFF80 };
+    int result = 0;
+    expectState(gameBoy);
+    forkGameBoy(&child, gameBoy);
+    for (size_t i = 0; i < sizeof(addresses) / sizeof(addresses[0]); i++) {
+        uint8_t value = (uint8_t)~readByte(&gameBoy->memory, addresses[i]);
+        writeByte(&child.memory, addresses[i], value);
+        if (readByte(&child.memory, addresses[i]) != value ||
+            readByte(&gameBoy->memory, addresses[i]) == value) {
+            error("Fork write to 0x%04X is not private to the fork", addresses[i]);
+            result = -1;
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        setGameBoyInput(&child, (uint8_t)~i);
+        runGameBoyFrame(&child);
+    }
+    if (!isExpectedState(gameBoy)) {
+        error("Running a fork changed its parent");
+        result = -1;
+    }
+    freeGameBoy(&child);
+    return result;
+}
+
+// Restoring a fork gives back the exact state, and the frames after it
+// replay the same
+static int checkRestore(GameBoy *gameBoy) {
+    static GameBoy snapshot;
+    static uint8_t ahead[STATE_MAX_SIZE];
+    uint32_t aheadSize;
+    expectState(gameBoy);
+    forkGameBoy(&snapshot, gameBoy);
+    for (int i = 0; i < 5; i++) {
+        setGameBoyInput(gameBoy, (uint8_t)(i * 3));
+        runGameBoyFrame(gameBoy);
+    }
+    aheadSize = saveGameBoyState(gameBoy, ahead);
+    restoreGameBoy(gameBoy, &snapshot);
+    if (!isExpectedState(gameBoy)) {
+        error("Restored state differs from the one forked");
+        return -1;
+    }
+    for (int i = 0; i < 5; i++) {
+        setGameBoyInput(gameBoy, (uint8_t)(i * 3));
+        runGameBoyFrame(gameBoy);
+    }
+    expectedSize = aheadSize;
+    memcpy(expectedState, ahead, aheadSize);
+    if (!isExpectedState(gameBoy)) {
+        error("Frames after a restore replay differently");
+        return -1;
+    }
+    return 0;
+}
+
+// Records a movie, then seeks around in it and compares each landing with
+// the state recorded at that frame
+static int checkMovieSeek(GameBoy *gameBoy, const char *moviePath) {
+    static const uint32_t seeks[] = STATE_CHECK_SEEKS;
+    static uint8_t states[sizeof(seeks) / sizeof(seeks[0])][STATE_MAX_SIZE];
+    static uint32_t sizes[sizeof(seeks) / sizeof(seeks[0])];
+    const size_t count = sizeof(seeks) / sizeof(seeks[0]);
+    Movie movie;
+    int result = 0;
+
+    if (startMovieRecording(&movie, moviePath, gameBoy) != 0) {
+        return -1;
+    }
+    for (uint32_t frame = 0; frame < STATE_CHECK_FRAMES; frame++) {
+        for (size_t i = 0; i < count; i++) {
+            if (seeks[i] == frame) {
+                sizes[i] = saveGameBoyState(gameBoy, states[i]);
+            }
+        }
+        setGameBoyInput(gameBoy, (uint8_t)(frame / 7 * 5));
+        if (recordMovieFrame(&movie, gameBoy) != 0) {
+            closeMovie(&movie);
+            return -1;
+        }
+        runGameBoyFrame(gameBoy);
+    }
+    if (closeMovie(&movie) != 0 || openMovie(&movie, moviePath, gameBoy) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < count && result == 0; i++) {
+        expectedSize = sizes[i];
+        memcpy(expectedState, states[i], sizes[i]);
+        if (seekMovie(&movie, gameBoy, seeks[i]) != 0 || !isExpectedState(gameBoy)) {
+            error("Seeking the movie to frame %u did not give the recorded state", seeks[i]);
+            result = -1;
+        }
+    }
+    if (closeMovie(&movie) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// Behaviour checks run by make check: forks are isolated from their
+// parent, and restoring a fork or seeking a movie gives back the exact state
+static int checkStates(void) {
+    static const Benchmark workload = {
+        "workload", "frame", 0, NULL, workloadProgram, sizeof(workloadProgram)
+    };
+    char moviePath[64];
+    snprintf(moviePath, sizeof(moviePath), "/tmp/nanobench-%d.nbm", (int)getpid());
+
+    GameBoy *gameBoy = aligned_alloc(CACHE_LINE_SIZE, sizeof(GameBoy));
+    if (!gameBoy || setupGameBoy(gameBoy, &workload, NULL) != 0) {
+        error("Failed to set up state check");
+        free(gameBoy);
+        return -1;
+    }
+    gameBoy->cpu.h = 0x80;
+    writeByte(&gameBoy->memory, 0xFF07, 0x05);  // Timer on, so its state is exercised too
+    for (int i = 0; i < 10; i++) {
+        setGameBoyInput(gameBoy, (uint8_t)i);
+        runGameBoyFrame(gameBoy);
+    }
+
+    int result = 0;
+    if (checkForkIsolation(gameBoy) != 0) {
+        result = -1;
+    }
+    if (checkRestore(gameBoy) != 0) {
+        result = -1;
+    }
+    if (checkMovieSeek(gameBoy, moviePath) != 0) {
+        result = -1;
+    }
+    freeGameBoy(gameBoy);
+    free(gameBoy);
+    remove(moviePath);
+    if (result == 0) {
+        success("State check: forks isolated, restores and movie seeks exact");
+    }
+    return result;
+}
+
+// Baseline files hold one "<name> <median ns>" line per benchmark; 0 if
+// the file or the entry is missing
+static double baselineMedian(const char *path, const char *name) {
+    FILE *file = fopen(path, "r");
+    char line[128], entry[64];
+    double median, found = 0;
+    if (!file) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%63s %lf", entry, &median) == 2 && strcmp(entry, name) == 0) {
+            found = median;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+static int saveBaseline(const char *path, const BenchResult *results, const int *selected) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        error("Failed to open baseline file: %s", path);
+        return -1;
+    }
+    for (int i = 0; i < BENCHMARK_COUNT; i++) {
+        if (selected[i]) {
+            fprintf(file, "%s %.3f\n", benchmarks[i].name, results[i].median);
+        }
+    }
+    if (ferror(file) | fclose(file)) {
+        error("Failed to write baseline file: %s", path);
+        return -1;
+    }
+    success("Baseline saved to %s", path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int runs = BENCH_DEFAULT_RUNS;
+    int warmup = BENCH_DEFAULT_WARMUP;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    const char *baselinePath = NULL;
+    const char *savePath = NULL;
+    const char *filter = NULL;
+    long checkFrames = -1;
+    long checkInstances = -1;
+    int checkState = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--check-alloc") == 0 && i + 1 < argc) {
+            checkFrames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--check-state") == 0) {
+            checkState = 1;
+        } else if (strcmp(argv[i], "--check-resident") == 0 && i + 1 < argc) {
+            checkInstances = atol(argv[++i]);
+        } else {
+            fprintf(stderr, "USAGE: %s [--runs <n>] [--warmup <n>] [--filter <substring>]\n"
+                    "       [--baseline <file> [--threshold <percent>]] [--save-baseline <file>]\n"
+                    "       [--check-alloc <frames>] [--check-resident <forks>] [--check-state]\n"
+                    "   --baseline  Compare medians and fail on regressions beyond the\n"
+                    "               threshold (default %.0f%%) or on benchmarks the file\n"
+                    "               has no entry for.\n"
+                    "   --check-alloc  Run the given number of frames instead and fail if\n"
+                    "               the emulation loop allocates from the heap.\n"
+                    "   --check-resident  Run the given number of forks instead and fail if\n"
+                    "               an instance averages over the resident budget.\n"
+                    "   --check-state  Check fork isolation, fork restore and movie seek\n"
+                    "               against saved states instead.\n",
+                    argv[0], BENCH_DEFAULT_THRESHOLD);
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0
+                ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (runs < 1 || runs > BENCH_MAX_RUNS || warmup < 0) {
+        error("Runs must be between 1 and %d", BENCH_MAX_RUNS);
+        return EXIT_FAILURE;
+    }
+
+    if (checkFrames >= 0) {
+        return checkAllocations((uint32_t)checkFrames) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (checkState) {
+        return checkStates() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (checkInstances > 0) {
+        return checkResident((uint32_t)checkInstances) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    FILE *baselineFile = baselinePath ? fopen(baselinePath, "r") : NULL;
+    if (baselinePath && !baselineFile) {
+        error("Failed to open baseline file: %s", baselinePath);
+        return EXIT_FAILURE;
+    }
+    if (baselineFile) {
+        fclose(baselineFile);
+    }
+
+    BenchResult results[BENCH_MAX];
+    int selected[BENCH_MAX] = { 0 };
+    int regressions = 0, missing = 0;
+    printf("%-12s %12s %12s %12s %12s  %-12s %s\n",
+           "benchmark", "median ns", "p90 ns", "p99 ns", "min ns", "per", "baseline");
+    for (int i = 0; i < BENCHMARK_COUNT; i++) {
+        const Benchmark *benchmark = &benchmarks[i];
+        if (filter && !strstr(benchmark->name, filter)) {
+            continue;
+        }
+        if (runBenchmark(benchmark, warmup, runs, &results[i]) != 0) {
+            return EXIT_FAILURE;
+        }
+        selected[i] = 1;
+
+        const BenchResult *result = &results[i];
+        printf("%-12s %12.2f %12.2f %12.2f %12.2f  %-12s", benchmark->name, result->median,
+               result->p90, result->p99, result->min, benchmark->unit);
+        double baseline = baselinePath ? baselineMedian(baselinePath, benchmark->name) : 0;
+        if (baseline > 0) {
+            double change = (result->median / baseline - 1) * 100;
+            int regressed = change > threshold;
+            regressions += regressed;
+            printf(" %+.1f%%%s", change, regressed ? " REGRESSION" : "");
+        } else if (baselinePath) {
+            missing++;
+            printf(" MISSING");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (savePath && saveBaseline(savePath, results, selected) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (missing) {
+        error("%d benchmark%s missing from baseline %s",
+              missing, missing == 1 ? "" : "s", baselinePath);
+    }
+    if (regressions) {
+        error("%d benchmark%s slower than baseline by more than %.1f%%",
+              regressions, regressions == 1 ? "" : "s", threshold);
+    }
+    return regressions || missing ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include "hosttime.h"
+#include "stats.h"
+#include "utils.h"
+
+// Reads the live stats page of running nanoboy instances
+
+static void listInstances(void) {
+    DIR *dir = opendir("/dev/shm");
+    struct dirent *entry;
+    int found = 0;
+    if (!dir) {
+        error("Failed to list /dev/shm");
+        return;
+    }
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, STATS_NAME_PREFIX + 1, strlen(STATS_NAME_PREFIX) - 1) != 0) {
+            continue;
+        }
+        int pid;
+        unsigned instance;
+        if (sscanf(entry->d_name + strlen(STATS_NAME_PREFIX) - 1, "%d-%u", &pid, &instance) != 2) {
+            continue;
+        }
+        const StatsPage *page = mapStats(pid, instance);
+        if (page) {
+            printf("%d/%u\t%s%s\n", pid, instance, page->title,
+                   kill(pid, 0) == 0 ? "" : " (not running)");
+            unmapStats(page);
+            found++;
+        }
+    }
+    closedir(dir);
+    if (!found) {
+        info("No running instances publish stats");
+    }
+}
+
+static void printSnapshot(const StatsSnapshot *now, const StatsSnapshot *last) {
+    uint64_t lookups = now->loopCacheHits + now->loopCacheMisses;
+    uint64_t frames = now->frames - (last ? last->frames : 0);
+    uint64_t nanos = now->updatedNanos - (last ? last->updatedNanos : 0);
+
+    printf("frames %llu  cycles %llu  instructions %llu  frame %.3f ms (avg %.3f)",
+           (unsigned long long)now->frames, (unsigned long long)now->cycles,
+           (unsigned long long)now->instructions, now->frameNanos / 1e6,
+           now->frames ? now->totalFrameNanos / 1e6 / now->frames : 0.0);
+    printf("  loop cache %.1f%% hits  accelerated %llu cycles",
+           lookups ? 100.0 * now->loopCacheHits / lookups : 0.0,
+           (unsigned long long)now->acceleratedCycles);
+    if (last && nanos) {
+        printf("  %.1f fps  %.2f emulated MHz  %.2f MIPS", frames * 1e9 / nanos,
+               (now->cycles - last->cycles) * 1e3 / nanos,
+               (now->instructions - last->instructions) * 1e3 / nanos);
+    }
+    printf("  age %.1f ms\n", (hostTimeNanos() - now->updatedNanos) / 1e6);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    long intervalMillis = 0;
+    int pid = 0;
+    unsigned instance = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            intervalMillis = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            fprintf(stderr, "USAGE: %s [-w <interval ms>] [<pid>[/<instance>]]\n"
+                    "   Without a pid, lists the instances publishing stats. The\n"
+                    "   instance defaults to the first one of the process.\n"
+                    "   -w  Keep sampling and print rates at the given interval.\n", argv[0]);
+            return EXIT_SUCCESS;
+        } else if (sscanf(argv[i], "%d/%u", &pid, &instance) < 1) {
+            error("Not a pid or pid/instance: %s", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (pid <= 0) {
+        listInstances();
+        return EXIT_SUCCESS;
+    }
+
+    const StatsPage *page = mapStats(pid, instance);
+    if (!page) {
+        return EXIT_FAILURE;
+    }
+    StatsSnapshot last, now;
+    int hasLast = 0;
+    do {
+        if (readStats(page, &now) != 0) {
+            error("Stats page kept changing while being read");
+        } else {
+            printSnapshot(&now, hasLast ? &last : NULL);
+            last = now;
+            hasLast = 1;
+        }
+        if (intervalMillis > 0) {
+            struct timespec delay = { intervalMillis / 1000, (intervalMillis % 1000) * 1000000 };
+            nanosleep(&delay, NULL);
+        }
+    } while (intervalMillis > 0 && kill(pid, 0) == 0);
+    unmapStats(page);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "utils.h"
+
+// Writes the regression test ROMs run by make check. Each ROM reports with
+// the harness's register convention: B, C, D, E, H, L set to 3, 5, 8, 13,
+// 21, 34 before LD B,B on success, all set to 0x42 on failure.
+
+#define ROM_SIZE (2 * ROM_BANK_SIZE)
+#define FAIL_ADDRESS 0x0150
+#define PASS_ADDRESS 0x0160
+#define CODE_START 0x0170
+
+typedef struct {
+    uint8_t rom[ROM_SIZE];
+    uint16_t pc;
+    int broken;  // A jump did not fit in a JR
+} Assembler;
+
+static void emitBytes(Assembler *as, const uint8_t *bytes, size_t count) {
+    memcpy(&as->rom[as->pc], bytes, count);
+    as->pc += count;
+}
+
+#define EMIT(as, ...) emitBytes(as, (const uint8_t[]){ __VA_ARGS__ }, \
+                                sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+// JR/JR cc to an address already emitted
+static void jumpTo(Assembler *as, uint8_t opcode, uint16_t target) {
+    int offset = target - (as->pc + 2);
+    if (offset < -128 || offset > 127) {
+        error("Jump from 0x%04X to 0x%04X out of range", as->pc, target);
+        as->broken = 1;
+    }
+    EMIT(as, opcode, (uint8_t)offset);
+}
+
+// Entry point, verdict routines and a ROM-only header
+static void startROM(Assembler *as) {
+    memset(as, 0, sizeof(*as));
+    as->pc = 0x0100;
+    jumpTo(as, 0x18, CODE_START);  // Over the header, which stays zero
+    as->pc = FAIL_ADDRESS;
+    EMIT(as, 0x06, 0x42, 0x0E, 0x42, 0x16, 0x42, 0x1E, 0x42, 0x26, 0x42, 0x2E, 0x42);
+    EMIT(as, 0x40, 0x18, 0xFE);  // LD B,B; JR -2
+    as->pc = PASS_ADDRESS;
+    EMIT(as, 0x06, 3, 0x0E, 5, 0x16, 8, 0x1E, 13, 0x26, 21, 0x2E, 34);
+    EMIT(as, 0x40, 0x18, 0xFE);
+    as->pc = CODE_START;
+}
+
+// Tetris-style nested clear: the inner and outer JR NZ share a loop start
+// and the outer one is reached with B already back at zero
+static void nestedClearROM(Assembler *as) {
+    EMIT(as, 0x3E, 0x5A);        // LD A,$5A
+    EMIT(as, 0x21, 0xFF, 0xDF);  // LD HL,$DFFF
+    EMIT(as, 0x0E, 0x10);        // LD C,$10
+    EMIT(as, 0x06, 0x00);        // LD B,0
+    uint16_t loop = as->pc;
+    EMIT(as, 0x32);              // LD (HL-),A
+    EMIT(as, 0x05);              // DEC B
+    jumpTo(as, 0x20, loop);      // JR NZ,loop
+    EMIT(as, 0x0D);              // DEC C
+    jumpTo(as, 0x20, loop);      // JR NZ,loop
+
+    EMIT(as, 0x21, 0x00, 0xD0);  // LD HL,$D000
+    uint16_t check = as->pc;
+    EMIT(as, 0x2A);              // LD A,(HL+)
+    EMIT(as, 0xFE, 0x5A);        // CP $5A
+    jumpTo(as, 0x20, FAIL_ADDRESS);
+    EMIT(as, 0x7C);              // LD A,H
+    EMIT(as, 0xFE, 0xE0);        // CP $E0
+    jumpTo(as, 0x20, check);
+    jumpTo(as, 0x18, PASS_ADDRESS);
+}
+
+// Waits for LY to reach (JR NZ) or leave (JR Z) the first vblank line
+static void waitForVBlank(Assembler *as, uint8_t opcode) {
+    uint16_t wait = as->pc;
+    EMIT(as, 0xF0, 0x44);        // LDH A,(LY)
+    EMIT(as, 0xFE, 0x90);        // CP 144
+    jumpTo(as, opcode, wait);
+}
+
+// Scrolls a patterned background by 3 pixels right and 1 down per frame,
+// writing SCX and SCY in vblank only. Run with --compare-ppu, it checks
+// that both PPU engines end on the same picture.
+static void scrollROM(Assembler *as) {
+    EMIT(as, 0x21, 0x00, 0x80);  // LD HL,$8000
+    uint16_t fill = as->pc;      // Tile data and map from L XOR H
+    EMIT(as, 0x7D, 0xAC, 0x22);  // LD A,L; XOR H; LD (HL+),A
+    EMIT(as, 0x7C);              // LD A,H
+    EMIT(as, 0xFE, 0x9C);        // CP $9C
+    jumpTo(as, 0x20, fill);
+
+    EMIT(as, 0x0E, 61);          // LD C,61, ending on a fine scroll of 7
+    uint16_t frame = as->pc;
+    waitForVBlank(as, 0x20);
+    EMIT(as, 0xF0, 0x43, 0xC6, 0x03, 0xE0, 0x43);  // SCX += 3
+    EMIT(as, 0xF0, 0x42, 0x3C, 0xE0, 0x42);        // SCY += 1
+    waitForVBlank(as, 0x28);
+    EMIT(as, 0x0D);              // DEC C
+    jumpTo(as, 0x20, frame);
+    waitForVBlank(as, 0x20);
+    jumpTo(as, 0x18, PASS_ADDRESS);
+}
+
+typedef struct {
+    const char *name;
+    void (*build)(Assembler *as);
+} TestROM;
+
+static const TestROM testROMs[] = {
+    { "nested-clear.gb", nestedClearROM },
+    { "scroll.gb", scrollROM },
+};
+
+int main(int argc, char *argv[]) {
+    static Assembler as;
+    char path[4096];
+    if (argc != 2) {
+        fprintf(stderr, "USAGE: %s <output directory>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sizeof(testROMs) / sizeof(testROMs[0]); i++) {
+        startROM(&as);
+        testROMs[i].build(&as);
+        snprintf(path, sizeof(path), "%s/%s", argv[1], testROMs[i].name);
+        FILE *file = fopen(path, "wb");
+        if (as.broken || !file || fwrite(as.rom, 1, ROM_SIZE, file) != ROM_SIZE) {
+            error("Failed to write %s", path);
+            if (file) fclose(file);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+    }
+    return EXIT_SUCCESS;
+}